@@ -0,0 +1,284 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ *
+ */
+
+// Command to convert a directory of pcaps:
+// ./waf --run "trace-replay-batch-convert --inputDir=captures --outputDir=traces --jobs=8"
+// inputDir  : directory with input pcap files (*.pcap, *.cap, *.pcapng, optionally .gz or .zst compressed)
+// outputDir : directory to write trace files to (<name>.txt for <name>.pcap or <name>.pcapng.gz)
+// jobs      : number of files converted at the same time (default: number of cores)
+//
+// Each pcap is converted by TraceReplayHelper, exactly as Install would
+// convert it, in a separate worker process. A malformed pcap makes only
+// its own worker exit, it is reported as failed and the remaining files
+// are still converted. Time taken and throughput are printed per file.
+// The program exits with status 1 if any file failed.
+//
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <ftw.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("TraceReplayBatchConvert");
+
+/**
+ * \brief A pcap being converted by a worker process
+ */
+struct Job
+{
+  std::string pcap;                                         //!< Name of the pcap file
+  std::string workDir;                                      //!< Directory the worker writes to
+  std::string tracePath;                                    //!< Final path of the trace file
+  uint64_t size;                                            //!< Size of the pcap file (bytes)
+  std::chrono::steady_clock::time_point start;              //!< Time the worker was started
+};
+
+/**
+ * \brief Finds the name of the trace file for a pcap
+ *
+ * \param name Name of the pcap file, like "user.pcapng.gz"
+ *
+ * \returns Name of the trace file (like "user.txt"), or empty if it is not a pcap
+ */
+static std::string
+TraceFileName (std::string name)
+{
+  // Compressed pcaps are read directly, the compression suffix is dropped too
+  const char* const compressed[] = { ".gz", ".zst" };
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      std::string suffix = compressed[i];
+      if (name.size () > suffix.size () && name.compare (name.size () - suffix.size (), suffix.size (), suffix) == 0)
+        {
+          name = name.substr (0, name.size () - suffix.size ());
+          break;
+        }
+    }
+  std::string::size_type dot = name.rfind ('.');
+  if (dot == std::string::npos || dot == 0)
+    {
+      return "";
+    }
+  std::string ext = name.substr (dot);
+  if (ext != ".pcap" && ext != ".cap" && ext != ".pcapng")
+    {
+      return "";
+    }
+  return name.substr (0, dot) + ".txt";
+}
+
+static int
+RemoveEntry (const char* path, const struct stat* st, int flag, struct FTW* ftw)
+{
+  return remove (path);
+}
+
+/**
+ * \brief Removes a worker directory, with anything a failed worker left in it
+ *
+ * \param path Directory to remove
+ */
+static void
+RemoveWorkDir (std::string path)
+{
+  nftw (path.c_str (), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string inputDir = "";
+  std::string outputDir = ".";
+  uint32_t jobs = std::thread::hardware_concurrency ();
+
+  CommandLine cmd;
+  cmd.AddValue ("inputDir", "directory with input pcap files", inputDir);
+  cmd.AddValue ("outputDir", "directory to write trace files to", outputDir);
+  cmd.AddValue ("jobs", "number of files converted at the same time", jobs);
+  cmd.Parse (argc, argv);
+
+  if (inputDir == "")
+    {
+      std::cerr << "No input directory given.\n";
+      exit (1);
+    }
+  if (jobs == 0)
+    {
+      jobs = 1;
+    }
+  mkdir (outputDir.c_str (), 0777);
+
+  DIR* dir = opendir (inputDir.c_str ());
+  if (dir == 0)
+    {
+      std::cerr << "Error opening input directory " << inputDir << ".\n";
+      exit (1);
+    }
+  std::vector<std::string> pcaps;
+  for (struct dirent* entry = readdir (dir); entry != 0; entry = readdir (dir))
+    {
+      if (!TraceFileName (entry->d_name).empty ())
+        {
+          pcaps.push_back (entry->d_name);
+        }
+    }
+  closedir (dir);
+  std::sort (pcaps.begin (), pcaps.end ());
+
+  // Pcaps which differ only in compression would write the same trace file
+  uint32_t numFailed = 0;
+  std::map<std::string, std::string> traceNames;
+  for (uint32_t i = 0; i < pcaps.size (); )
+    {
+      std::string traceName = TraceFileName (pcaps[i]);
+      if (traceNames.count (traceName))
+        {
+          std::cout << pcaps[i] << "\tFAILED (same trace file as " << traceNames[traceName] << ")\n";
+          numFailed++;
+          pcaps.erase (pcaps.begin () + i);
+          continue;
+        }
+      traceNames[traceName] = pcaps[i];
+      i++;
+    }
+  uint32_t numPcaps = pcaps.size () + numFailed;
+
+  // Bounded pool of worker processes, one pcap each
+  std::map<pid_t, Job> running;
+  uint32_t next = 0;
+  uint64_t totBytes = 0;
+  std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now ();
+  while (next < pcaps.size () || !running.empty ())
+    {
+      while (next < pcaps.size () && running.size () < jobs)
+        {
+          Job job;
+          job.pcap = pcaps[next++];
+          std::string pcapPath = inputDir + "/" + job.pcap;
+          std::string traceName = TraceFileName (job.pcap);
+          job.tracePath = outputDir + "/" + traceName;
+          // Scratch files of a worker which exits on error are removed with its directory
+          job.workDir = outputDir + "/.convert-" + traceName;
+          RemoveWorkDir (job.workDir);
+          if (mkdir (job.workDir.c_str (), 0777) != 0)
+            {
+              std::cerr << "Error creating directory " << job.workDir << ".\n";
+              exit (1);
+            }
+          std::string workPath = job.workDir + "/" + traceName;
+          struct stat st;
+          job.size = stat (pcapPath.c_str (), &st) == 0 ? st.st_size : 0;
+          job.start = std::chrono::steady_clock::now ();
+          std::cout.flush ();
+          pid_t pid = fork ();
+          if (pid < 0)
+            {
+              std::cerr << "Error starting worker process.\n";
+              exit (1);
+            }
+          if (pid == 0)
+            {
+              // Workers already keep every core busy, one thread per file is enough.
+              // Data rate is only used by installed applications.
+              TraceReplayHelper helper (DataRate ("25MBps"));
+              helper.SetNumThreads (1);
+              helper.SetCacheDirectory ("");
+              helper.SetPcap (pcapPath);
+              helper.ConvertPcap (workPath);
+              _exit (0);
+            }
+          running[pid] = job;
+        }
+
+      int status;
+      pid_t pid = waitpid (-1, &status, 0);
+      if (pid < 0)
+        {
+          break;
+        }
+      std::map<pid_t, Job>::iterator it = running.find (pid);
+      if (it == running.end ())
+        {
+          continue;
+        }
+      Job& job = it->second;
+      double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - job.start).count ();
+      bool converted = WIFEXITED (status) && WEXITSTATUS (status) == 0;
+      if (converted)
+        {
+          std::string traceName = job.tracePath.substr (outputDir.size () + 1);
+          converted = std::rename ((job.workDir + "/" + traceName).c_str (), job.tracePath.c_str ()) == 0;
+        }
+      RemoveWorkDir (job.workDir);
+      if (converted)
+        {
+          double megaBytes = job.size / 1e6;
+          totBytes += job.size;
+          std::cout << job.pcap << "\t" << std::fixed << std::setprecision (3)
+                    << seconds << " s\t" << megaBytes << " MB\t"
+                    << (seconds > 0 ? megaBytes / seconds : 0) << " MB/s\n";
+        }
+      else
+        {
+          numFailed++;
+          std::cout << job.pcap << "\tFAILED (";
+          if (WIFEXITED (status) && WEXITSTATUS (status) == 0)
+            {
+              std::cout << "error moving trace file";
+            }
+          else if (WIFEXITED (status))
+            {
+              std::cout << "exit status " << WEXITSTATUS (status);
+            }
+          else
+            {
+              std::cout << "signal " << WTERMSIG (status);
+            }
+          std::cout << ")\n";
+        }
+      running.erase (it);
+    }
+
+  double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - batchStart).count ();
+  std::cout << "Converted " << numPcaps - numFailed << " of " << numPcaps
+            << " files, " << std::fixed << std::setprecision (3) << totBytes / 1e6
+            << " MB in " << seconds << " s ("
+            << (seconds > 0 ? totBytes / 1e6 / seconds : 0) << " MB/s) using "
+            << jobs << " jobs\n";
+  return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,540 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ *
+ */
+
+// Command to generate a synthetic pcap and benchmark its conversion:
+// ./waf --run "trace-replay-benchmark --flows=10000 --fanout=8 --thinkTime=2"
+// flows        : number of tcp connections in the pcap (default 1000)
+// fanout       : number of parallel connections to the same server at the same time (default 4)
+// requests     : number of http requests on each connection (default 5)
+// thinkTime    : mean time between a response and the next request, in seconds (default 2)
+// responseSize : mean size of a response, in bytes (default 20000)
+// sizeMb       : if not 0, connections are added till the pcap has this size and flows is ignored
+// seed         : seed of the generator, same parameters and seed give the same pcap (default 1)
+// pcap         : path of the generated pcap (default trace-replay-benchmark.pcap)
+// generateOnly : only write the pcap, without converting it
+// threads      : number of threads used to decode the pcap (default 1)
+//
+// The pcap has a single client (as expected by TraceReplay) and one server
+// per group of parallel connections. Each connection does a handshake, sends
+// requests separated by exponentially distributed think times, receives
+// mss sized response segments and is closed by FIN from both sides.
+//
+// Stages of the conversion:
+//  - decode: TraceReplayPcapReader alone, reading every tcp segment in one thread
+//  - decode + tracking: decode (with the given threads) and mapping of segments to connections,
+//    which are interleaved in a conversion and can not be timed apart
+//  - writing: printing the trace file
+// Decode, a conversion and an append each run in a separate process. Times and
+// peak RSS of the other stages are those measured by the conversion at stage
+// boundaries (see TraceReplayConversionStats), the peak RSS being reset at the
+// start of each stage on Linux. Rates are pcap packets (tcp segments) and pcap
+// bytes per second of the stage.
+//
+// Two parts of the conversion are reported apart, without pcap rates:
+//  - parallel connection snapshots: listing the parallel connections of each
+//    delayed packet during tracking (part of decode + tracking), which grows
+//    with fanout; the rate is listed parallel connections per second
+//  - state saving: saving the open connections at the end of AppendPcap
+//
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("TraceReplayBenchmark");
+
+// Round trip time between client and server, and time between two segments of a response (seconds)
+static const double RTT = 0.02;
+static const double SEGMENT_GAP = 0.0002;
+static const uint32_t MSS = 1448;
+static const uint32_t REQUEST_SIZE = 400;
+
+/**
+ * \brief Parameters of the synthetic pcap
+ */
+struct GeneratorParams
+{
+  uint32_t        flows;            //!< Number of connections
+  uint32_t        fanout;           //!< Number of parallel connections to the same server
+  uint32_t        requests;         //!< Number of requests on each connection
+  double          thinkTime;        //!< Mean time between a response and the next request (seconds)
+  uint32_t        responseSize;     //!< Mean size of a response (bytes)
+  uint64_t        size;             //!< Size of the pcap (bytes), 0 if flows is used
+  uint64_t        seed;             //!< Seed of the random number generator
+};
+
+/**
+ * \brief A tcp segment of the synthetic pcap
+ */
+struct Segment
+{
+  double          time;             //!< Time of the segment (seconds from the start of the capture)
+  uint32_t        conn;             //!< Index of the connection in its group
+  bool            fromClient;       //!< True if the segment is sent by the client
+  uint8_t         flags;            //!< tcp flags
+  uint32_t        seq;              //!< Sequence number
+  uint32_t        ack;              //!< Ack number
+  uint32_t        payloadSize;      //!< Size of the tcp payload
+  bool            request;          //!< True if the payload is a http request
+
+  /**
+   * \brief Orders the segments by time, keeping the order of segments with the same time
+   */
+  bool operator< (const Segment& rhs) const
+  {
+    return time < rhs.time;
+  }
+};
+
+/**
+ * \brief Endpoints and sequence numbers of a connection of the synthetic pcap
+ */
+struct Connection
+{
+  uint8_t         ipServer[4];      //!< Ip address of the server
+  uint16_t        portClient;       //!< Port number of the client
+  uint32_t        seqClient;        //!< Next sequence number of the client
+  uint32_t        seqServer;        //!< Next sequence number of the server
+};
+
+/**
+ * \brief Returns a random number uniformly distributed in [0, 1)
+ *
+ * Computed from the raw output of the generator, which is the same on
+ * every platform, unlike the distributions of the standard library.
+ */
+static double
+Uniform (std::mt19937_64& rng)
+{
+  return (rng () >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void
+PutUint16 (std::vector<uint8_t>& frame, uint32_t offset, uint16_t value)
+{
+  frame[offset] = value >> 8;
+  frame[offset + 1] = value & 0xff;
+}
+
+static void
+PutUint32 (std::vector<uint8_t>& frame, uint32_t offset, uint32_t value)
+{
+  PutUint16 (frame, offset, value >> 16);
+  PutUint16 (frame, offset + 2, value & 0xffff);
+}
+
+static void
+WriteLittleEndian (std::ostream& file, uint32_t value)
+{
+  char bytes[4] = { (char) (value & 0xff), (char) ((value >> 8) & 0xff), (char) ((value >> 16) & 0xff), (char) (value >> 24) };
+  file.write (bytes, 4);
+}
+
+/**
+ * \brief Writes a segment as an Ethernet/IPv4/tcp frame with a pcap record header
+ *
+ * \param file Pcap file
+ * \param segment Segment to write
+ * \param conn Connection of the segment
+ * \param startSec Time of the start of the capture (seconds since the epoch)
+ *
+ * \returns Number of bytes written
+ */
+static uint64_t
+WriteSegment (std::ostream& file, const Segment& segment, const Connection& conn, uint32_t startSec)
+{
+  static const uint8_t client[4] = { 192, 168, 1, 10 };
+  std::vector<uint8_t> frame (54 + segment.payloadSize, 0);
+  // Ethernet: destination and source mac, EtherType
+  frame[5] = segment.fromClient ? 2 : 1;
+  frame[11] = segment.fromClient ? 1 : 2;
+  PutUint16 (frame, 12, 0x0800);
+  // IPv4 without options, checksums are left as 0
+  frame[14] = 0x45;
+  PutUint16 (frame, 16, 40 + segment.payloadSize);
+  frame[22] = 64;
+  frame[23] = 6;
+  std::memcpy (&frame[26], segment.fromClient ? client : conn.ipServer, 4);
+  std::memcpy (&frame[30], segment.fromClient ? conn.ipServer : client, 4);
+  // tcp without options
+  PutUint16 (frame, 34, segment.fromClient ? conn.portClient : 80);
+  PutUint16 (frame, 36, segment.fromClient ? 80 : conn.portClient);
+  PutUint32 (frame, 38, segment.seq);
+  PutUint32 (frame, 42, segment.ack);
+  frame[46] = 0x50;
+  frame[47] = segment.flags;
+  PutUint16 (frame, 48, 65535);
+  if (segment.request)
+    {
+      std::string request = "GET /object HTTP/1.1\r\nHost: server\r\n";
+      std::memcpy (&frame[54], request.data (), std::min<size_t> (request.size (), segment.payloadSize));
+    }
+
+  double time = std::floor (segment.time * 1e6 + 0.5) / 1e6;
+  uint32_t sec = (uint32_t) time;
+  WriteLittleEndian (file, startSec + sec);
+  WriteLittleEndian (file, (uint32_t) ((time - sec) * 1e6 + 0.5) % 1000000);
+  WriteLittleEndian (file, frame.size ());
+  WriteLittleEndian (file, frame.size ());
+  file.write ((const char*) &frame[0], frame.size ());
+  return 16 + frame.size ();
+}
+
+/**
+ * \brief Writes a synthetic pcap
+ *
+ * Connections are generated in groups of params.fanout parallel connections
+ * to the same server. A group starts when the previous one has ended, so
+ * only one group is kept in memory.
+ *
+ * \param path Path of the pcap
+ * \param params Parameters of the pcap
+ * \param numSegments Set to the number of tcp segments written
+ *
+ * \returns Size of the pcap (bytes)
+ */
+static uint64_t
+GeneratePcap (std::string path, const GeneratorParams& params, uint64_t& numSegments)
+{
+  std::ofstream file (path.c_str (), std::ios::binary);
+  if (!file.is_open ())
+    {
+      std::cerr << "Error creating pcap file " << path << ".\n";
+      exit (1);
+    }
+  // Global header: microsecond timestamps, version 2.4, snaplen, Ethernet
+  WriteLittleEndian (file, 0xa1b2c3d4);
+  WriteLittleEndian (file, 0x00040002);
+  WriteLittleEndian (file, 0);
+  WriteLittleEndian (file, 0);
+  WriteLittleEndian (file, 262144);
+  WriteLittleEndian (file, 1);
+  uint64_t size = 24;
+  numSegments = 0;
+
+  std::mt19937_64 rng (params.seed);
+  const uint32_t startSec = 1500000000;
+  uint32_t fanout = std::max<uint32_t> (params.fanout, 1);
+  uint32_t numConns = 0;
+  double groupStart = 0;
+  for (uint32_t group = 0; params.size > 0 ? size < params.size : numConns < params.flows; group++)
+    {
+      uint32_t groupSize = params.size > 0 ? fanout : std::min (fanout, params.flows - numConns);
+      std::vector<Connection> conns (groupSize);
+      std::vector<Segment> segments;
+      double groupEnd = groupStart;
+      for (uint32_t k = 0; k < groupSize; k++)
+        {
+          Connection& conn = conns[k];
+          conn.ipServer[0] = 10;
+          conn.ipServer[1] = ((group + 1) >> 16) & 0xff;
+          conn.ipServer[2] = ((group + 1) >> 8) & 0xff;
+          conn.ipServer[3] = (group + 1) & 0xff;
+          conn.portClient = 1024 + (numConns++ % 64000);
+          conn.seqClient = rng ();
+          conn.seqServer = rng ();
+
+          Segment segment;
+          segment.conn = k;
+          segment.request = false;
+          segment.payloadSize = 0;
+          std::function<void (double, bool, uint8_t, uint32_t)> add = [&] (double time, bool fromClient, uint8_t flags, uint32_t payloadSize)
+            {
+              segment.time = time;
+              segment.fromClient = fromClient;
+              segment.flags = flags;
+              segment.payloadSize = payloadSize;
+              segment.seq = fromClient ? conn.seqClient : conn.seqServer;
+              segment.ack = (flags & 0x10) ? (fromClient ? conn.seqServer : conn.seqClient) : 0;
+              segments.push_back (segment);
+              segment.request = false;
+              uint32_t& seq = fromClient ? conn.seqClient : conn.seqServer;
+              seq += payloadSize + ((flags & 0x03) ? 1 : 0);
+            };
+
+          // Handshake, parallel connections are opened a few ms apart
+          double time = groupStart + k * 0.005;
+          add (time, true, 0x02, 0);
+          add (time + RTT / 2, false, 0x12, 0);
+          time += RTT;
+          add (time, true, 0x10, 0);
+          for (uint32_t r = 0; r < params.requests; r++)
+            {
+              // Think time before each request after the first one
+              time += r == 0 ? 0.001 : -params.thinkTime * std::log (1 - Uniform (rng));
+              segment.request = true;
+              add (time, true, 0x18, REQUEST_SIZE);
+              time += RTT;
+              uint32_t response = params.responseSize * (0.5 + Uniform (rng));
+              for (uint32_t sent = 0, n = 0; sent < response; n++)
+                {
+                  uint32_t payloadSize = std::min (MSS, response - sent);
+                  sent += payloadSize;
+                  add (time, false, sent == response ? 0x18 : 0x10, payloadSize);
+                  if (n % 2 == 1 || sent == response)
+                    {
+                      // Delayed ack of every second segment
+                      add (time + RTT / 2, true, 0x10, 0);
+                    }
+                  time += SEGMENT_GAP;
+                }
+            }
+          time += RTT;
+          add (time, true, 0x11, 0);
+          add (time + RTT / 2, false, 0x11, 0);
+          add (time + RTT, true, 0x10, 0);
+          groupEnd = std::max (groupEnd, time + RTT);
+        }
+
+      std::stable_sort (segments.begin (), segments.end ());
+      for (uint32_t i = 0; i < segments.size (); i++)
+        {
+          size += WriteSegment (file, segments[i], conns[segments[i].conn], startSec);
+        }
+      numSegments += segments.size ();
+      groupStart = groupEnd + 0.5;
+    }
+
+  file.close ();
+  if (file.fail ())
+    {
+      std::cerr << "Error writing pcap file " << path << ".\n";
+      exit (1);
+    }
+  return size;
+}
+
+/**
+ * \brief Time and memory taken by decoding the pcap alone
+ */
+struct DecodeStats
+{
+  uint64_t        numSegments;      //!< Number of tcp segments decoded
+  double          time;             //!< Time to decode the pcap (seconds)
+  uint64_t        rss;              //!< Peak RSS of the process (KB)
+};
+
+/**
+ * \brief Returns the peak RSS of the process since it started or since its
+ * reset through /proc/self/clear_refs
+ *
+ * \returns Peak RSS (KB)
+ */
+static uint64_t
+GetPeakRss (void)
+{
+  std::ifstream file ("/proc/self/status");
+  std::string line;
+  while (std::getline (file, line))
+    {
+      if (line.compare (0, 6, "VmHWM:") == 0)
+        {
+          return std::strtoull (line.c_str () + 6, 0, 10);
+        }
+    }
+  // A forked child inherits the peak of its parent here
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/**
+ * \brief Runs a stage in a child process and gets its statistics
+ *
+ * \param stage Function run by the child, returning the statistics of the stage
+ *
+ * \returns Statistics returned by the child
+ */
+template <typename Stats>
+static Stats
+RunStage (std::function<Stats ()> stage)
+{
+  int fds[2];
+  if (pipe (fds) != 0)
+    {
+      std::cerr << "Error creating pipe.\n";
+      exit (1);
+    }
+  std::cout.flush ();
+  pid_t pid = fork ();
+  if (pid < 0)
+    {
+      std::cerr << "Error starting stage process.\n";
+      exit (1);
+    }
+  if (pid == 0)
+    {
+      close (fds[0]);
+      Stats stats = stage ();
+      if (write (fds[1], &stats, sizeof (stats)) != sizeof (stats))
+        {
+          _exit (1);
+        }
+      _exit (0);
+    }
+  close (fds[1]);
+  Stats stats;
+  bool complete = read (fds[0], &stats, sizeof (stats)) == sizeof (stats);
+  close (fds[0]);
+  int status;
+  waitpid (pid, &status, 0);
+  if (!complete || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    {
+      std::cerr << "Stage process failed.\n";
+      exit (1);
+    }
+  return stats;
+}
+
+/**
+ * \brief Prints a row of the benchmark results
+ */
+static void
+PrintStage (std::string name, double seconds, uint64_t numSegments, uint64_t size, uint64_t rss)
+{
+  std::cout << std::left << std::setw (16) << name << std::right << std::fixed << std::setprecision (3)
+            << std::setw (10) << seconds
+            << std::setw (14) << std::setprecision (0) << (seconds > 0 ? numSegments / seconds : 0)
+            << std::setw (12) << std::setprecision (1) << (seconds > 0 ? size / 1e6 / seconds : 0)
+            << std::setw (14) << rss / 1024.0 << "\n";
+}
+
+int
+main (int argc, char *argv[])
+{
+  GeneratorParams params;
+  params.flows = 1000;
+  params.fanout = 4;
+  params.requests = 5;
+  params.thinkTime = 2;
+  params.responseSize = 20000;
+  params.seed = 1;
+  double sizeMb = 0;
+  std::string pcap = "trace-replay-benchmark.pcap";
+  bool generateOnly = false;
+  uint32_t threads = 1;
+
+  CommandLine cmd;
+  cmd.AddValue ("flows", "number of tcp connections in the pcap", params.flows);
+  cmd.AddValue ("fanout", "number of parallel connections to the same server", params.fanout);
+  cmd.AddValue ("requests", "number of http requests on each connection", params.requests);
+  cmd.AddValue ("thinkTime", "mean time between a response and the next request (seconds)", params.thinkTime);
+  cmd.AddValue ("responseSize", "mean size of a response (bytes)", params.responseSize);
+  cmd.AddValue ("sizeMb", "size of the pcap (MB), overrides flows if not 0", sizeMb);
+  cmd.AddValue ("seed", "seed of the generator", params.seed);
+  cmd.AddValue ("pcap", "path of the generated pcap", pcap);
+  cmd.AddValue ("generateOnly", "only write the pcap", generateOnly);
+  cmd.AddValue ("threads", "number of threads used to decode the pcap", threads);
+  cmd.Parse (argc, argv);
+  params.size = sizeMb * 1e6;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  uint64_t numSegments;
+  uint64_t size = GeneratePcap (pcap, params, numSegments);
+  double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+  std::cout << "Generated " << pcap << ": " << numSegments << " packets, " << std::fixed << std::setprecision (1)
+            << size / 1e6 << " MB in " << std::setprecision (3) << seconds << " s\n";
+  if (generateOnly)
+    {
+      return 0;
+    }
+
+  std::string traceFile = pcap + ".txt";
+  DecodeStats decode = RunStage<DecodeStats> ([&] ()
+    {
+      DecodeStats stats = DecodeStats ();
+      {
+        // Peak of the generator is not part of the decode
+        std::ofstream clearRefs ("/proc/self/clear_refs");
+        clearRefs << "5";
+      }
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      TraceReplayPcapReader reader;
+      if (!reader.Open (pcap))
+        {
+          _exit (1);
+        }
+      TraceReplayPcapRecord record;
+      while (reader.ReadNext (record))
+        {
+          stats.numSegments++;
+        }
+      reader.Close ();
+      stats.time = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+      stats.rss = GetPeakRss ();
+      return stats;
+    });
+  TraceReplayConversionStats convert = RunStage<TraceReplayConversionStats> ([&] ()
+    {
+      // Data rate is only used by installed applications
+      TraceReplayHelper helper (DataRate ("25MBps"));
+      helper.SetNumThreads (threads);
+      helper.SetCacheDirectory ("");
+      helper.SetPcap (pcap);
+      helper.ConvertPcap (traceFile);
+      return helper.GetConversionStats ();
+    });
+  TraceReplayConversionStats append = RunStage<TraceReplayConversionStats> ([&] ()
+    {
+      TraceReplayHelper helper (DataRate ("25MBps"));
+      helper.SetNumThreads (threads);
+      helper.SetPcap (pcap);
+      helper.AppendPcap (traceFile);
+      return helper.GetConversionStats ();
+    });
+  std::remove (traceFile.c_str ());
+  std::remove ((traceFile + ".state").c_str ());
+
+  std::cout << convert.numConnections << " connections, " << decode.numSegments << " tcp segments, "
+            << convert.numSegments << " mapped to connections\n";
+  std::cout << std::left << std::setw (16) << "stage" << std::right << std::setw (10) << "time (s)"
+            << std::setw (14) << "packets/s" << std::setw (12) << "MB/s" << std::setw (14) << "peak RSS (MB)" << "\n";
+  PrintStage ("decode", decode.time, decode.numSegments, size, decode.rss);
+  PrintStage ("decode+tracking", convert.trackTime, convert.numSegments, size, convert.trackRss);
+  PrintStage ("writing", convert.writeTime, convert.numSegments, size, convert.writeRss);
+  std::cout << std::fixed << "parallel connection snapshots: " << convert.numParallelLists << " packets, "
+            << convert.numParallelEntries << " connections listed in " << std::setprecision (6)
+            << convert.parallelTime << " s (" << std::setprecision (0)
+            << (convert.parallelTime > 0 ? convert.numParallelEntries / convert.parallelTime : 0)
+            << " connections/s), part of decode+tracking\n";
+  std::cout << "state saving (append): " << std::setprecision (6) << append.stateTime << " s, peak RSS "
+            << std::setprecision (1) << append.stateRss / 1024.0 << " MB\n";
+  return 0;
+}
@@ -0,0 +1,459 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ */
+
+#include "trace-replay-field-parser.h"
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+namespace ns3 {
+
+// Powers of ten which are exactly representable as double
+static const double POW10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+TraceReplayFieldParser::TraceReplayFieldParser (std::string source)
+  : m_source (source),
+    m_line (0),
+    m_pos (0),
+    m_end (0),
+    m_lineNum (0)
+{
+}
+
+bool
+TraceReplayFieldParser::ReadLine (std::istream& input)
+{
+  while (std::getline (input, m_buffer))
+    {
+      m_lineNum++;
+      if (!m_buffer.empty () && m_buffer[0] == '#')
+        {
+          // comment line
+          continue;
+        }
+      m_line = m_buffer.data ();
+      m_pos = m_line;
+      m_end = m_line + m_buffer.size ();
+      return true;
+    }
+  // Errors after the end of input are reported at its last line
+  m_line = 0;
+  m_pos = 0;
+  m_end = 0;
+  return false;
+}
+
+void
+TraceReplayFieldParser::SetLine (const char* line, size_t length)
+{
+  m_lineNum++;
+  m_line = line;
+  m_pos = line;
+  m_end = line + length;
+  while (m_end > m_line && (m_end[-1] == '\n' || m_end[-1] == '\r'))
+    {
+      m_end--;
+    }
+}
+
+void
+TraceReplayFieldParser::SkipSpace ()
+{
+  while (m_pos < m_end && (*m_pos == '\t' || *m_pos == ' ' || *m_pos == '\r'))
+    {
+      m_pos++;
+    }
+}
+
+const char*
+TraceReplayFieldParser::FieldEnd () const
+{
+  const char* p = m_pos;
+  while (p < m_end && *p != '\t' && *p != ' ' && *p != '\r')
+    {
+      p++;
+    }
+  return p;
+}
+
+bool
+TraceReplayFieldParser::AtEnd ()
+{
+  SkipSpace ();
+  return m_pos == m_end;
+}
+
+void
+TraceReplayFieldParser::ExpectEnd ()
+{
+  if (!AtEnd ())
+    {
+      Fail ("unexpected field at end of line");
+    }
+}
+
+uint64_t
+TraceReplayFieldParser::ReadUnsigned (uint64_t max)
+{
+  SkipSpace ();
+  const char* end = FieldEnd ();
+  if (m_pos == end)
+    {
+      Fail ("missing number");
+    }
+  uint64_t value = 0;
+  for (const char* p = m_pos; p < end; p++)
+    {
+      if (*p < '0' || *p > '9')
+        {
+          m_pos = p;
+          Fail ("expected a digit");
+        }
+      uint32_t digit = *p - '0';
+      if (value > (max - digit) / 10)
+        {
+          Fail ("number out of range");
+        }
+      value = value * 10 + digit;
+    }
+  m_pos = end;
+  return value;
+}
+
+uint32_t
+TraceReplayFieldParser::ReadUint32 ()
+{
+  return ReadUnsigned (0xffffffff);
+}
+
+uint16_t
+TraceReplayFieldParser::ReadUint16 ()
+{
+  return ReadUnsigned (0xffff);
+}
+
+uint32_t
+TraceReplayFieldParser::ReadHex ()
+{
+  SkipSpace ();
+  const char* end = FieldEnd ();
+  const char* p = m_pos;
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+    {
+      p += 2;
+    }
+  if (p == end)
+    {
+      Fail ("missing hexadecimal number");
+    }
+  uint32_t value = 0;
+  for (; p < end; p++)
+    {
+      uint32_t digit;
+      if (*p >= '0' && *p <= '9')
+        {
+          digit = *p - '0';
+        }
+      else if (*p >= 'a' && *p <= 'f')
+        {
+          digit = *p - 'a' + 10;
+        }
+      else if (*p >= 'A' && *p <= 'F')
+        {
+          digit = *p - 'A' + 10;
+        }
+      else
+        {
+          m_pos = p;
+          Fail ("expected a hexadecimal digit");
+          return 0;
+        }
+      if (value >> 28)
+        {
+          Fail ("number out of range");
+        }
+      value = (value << 4) | digit;
+    }
+  m_pos = end;
+  return value;
+}
+
+double
+TraceReplayFieldParser::ReadDouble ()
+{
+  SkipSpace ();
+  const char* end = FieldEnd ();
+  const char* p = m_pos;
+  // Decimal digits are collected into an integer mantissa and a power of ten
+  uint64_t mantissa = 0;
+  int32_t exponent = 0;
+  uint32_t numDigits = 0;
+  bool exact = true;
+  for (; p < end && *p >= '0' && *p <= '9'; p++, numDigits++)
+    {
+      if (mantissa < 1000000000000000000ULL)
+        {
+          mantissa = mantissa * 10 + (*p - '0');
+        }
+      else
+        {
+          exponent++;
+          exact = false;
+        }
+    }
+  if (p < end && *p == '.')
+    {
+      for (p++; p < end && *p >= '0' && *p <= '9'; p++, numDigits++)
+        {
+          if (mantissa < 1000000000000000000ULL)
+            {
+              mantissa = mantissa * 10 + (*p - '0');
+              exponent--;
+            }
+          else
+            {
+              exact = false;
+            }
+        }
+    }
+  if (numDigits == 0)
+    {
+      Fail ("expected a number");
+    }
+  if (p < end && (*p == 'e' || *p == 'E'))
+    {
+      p++;
+      bool negative = false;
+      if (p < end && (*p == '-' || *p == '+'))
+        {
+          negative = *p == '-';
+          p++;
+        }
+      if (p == end || *p < '0' || *p > '9')
+        {
+          m_pos = p;
+          Fail ("expected exponent digits");
+        }
+      int32_t value = 0;
+      for (; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+          if (value < 10000)
+            {
+              value = value * 10 + (*p - '0');
+            }
+        }
+      exponent += negative ? -value : value;
+    }
+  if (p != end)
+    {
+      m_pos = p;
+      Fail ("unexpected character in number");
+    }
+
+  double value;
+  if (exact && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+      // Both the mantissa and the power of ten are exact, so a single
+      // multiplication or division gives the correctly rounded value
+      value = exponent < 0 ? mantissa / POW10[-exponent] : mantissa * POW10[exponent];
+    }
+  else
+    {
+      // Rare long or large numbers, let the C library round them
+      char buffer[64];
+      if (end - m_pos >= (long) sizeof (buffer))
+        {
+          Fail ("number too long");
+        }
+      std::memcpy (buffer, m_pos, end - m_pos);
+      buffer[end - m_pos] = '\0';
+      value = std::strtod (buffer, 0);
+    }
+  m_pos = end;
+  return value;
+}
+
+bool
+TraceReplayFieldParser::ParseIpv4 (const char* begin, const char* end, uint8_t ip[4])
+{
+  const char* p = begin;
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      if (i > 0)
+        {
+          if (p == end || *p != '.')
+            {
+              return false;
+            }
+          p++;
+        }
+      uint32_t value = 0;
+      uint32_t numDigits = 0;
+      for (; p < end && *p >= '0' && *p <= '9' && numDigits < 4; p++, numDigits++)
+        {
+          value = value * 10 + (*p - '0');
+        }
+      if (numDigits == 0 || value > 255)
+        {
+          return false;
+        }
+      ip[i] = value;
+    }
+  return p == end;
+}
+
+bool
+TraceReplayFieldParser::ParseIpv6 (const char* begin, const char* end, uint8_t ip[16])
+{
+  // Groups before and after "::" are collected separately
+  uint8_t tail[16];
+  uint32_t numHead = 0;
+  uint32_t numTail = 0;
+  bool compressed = false;
+  const char* p = begin;
+  if (end - p >= 2 && p[0] == ':' && p[1] == ':')
+    {
+      compressed = true;
+      p += 2;
+    }
+  while (p < end)
+    {
+      uint32_t& numBytes = compressed ? numTail : numHead;
+      uint8_t* group = compressed ? tail + numTail : ip + numHead;
+      // Trailing IPv4 part, like ::ffff:10.0.0.1
+      const char* q = p;
+      while (q < end && *q != ':' && *q != '.')
+        {
+          q++;
+        }
+      if (q < end && *q == '.')
+        {
+          if (numBytes + 4 > 16 || !ParseIpv4 (p, end, group))
+            {
+              return false;
+            }
+          numBytes += 4;
+          p = end;
+          break;
+        }
+      uint32_t value = 0;
+      uint32_t numDigits = 0;
+      for (; p < end && *p != ':'; p++, numDigits++)
+        {
+          uint32_t digit;
+          if (*p >= '0' && *p <= '9')
+            {
+              digit = *p - '0';
+            }
+          else if (*p >= 'a' && *p <= 'f')
+            {
+              digit = *p - 'a' + 10;
+            }
+          else if (*p >= 'A' && *p <= 'F')
+            {
+              digit = *p - 'A' + 10;
+            }
+          else
+            {
+              return false;
+            }
+          value = (value << 4) | digit;
+        }
+      if (numDigits == 0 || numDigits > 4 || numBytes + 2 > 16)
+        {
+          return false;
+        }
+      group[0] = value >> 8;
+      group[1] = value & 0xff;
+      numBytes += 2;
+      if (p < end)
+        {
+          // skip ':', a second one starts the compressed zeros
+          p++;
+          if (p < end && *p == ':')
+            {
+              if (compressed)
+                {
+                  return false;
+                }
+              compressed = true;
+              p++;
+            }
+          else if (p == end)
+            {
+              return false;
+            }
+        }
+    }
+  if (!compressed)
+    {
+      return numHead == 16;
+    }
+  if (numHead + numTail > 14)
+    {
+      return false;
+    }
+  std::memset (ip + numHead, 0, 16 - numHead - numTail);
+  std::memcpy (ip + 16 - numTail, tail, numTail);
+  return true;
+}
+
+bool
+TraceReplayFieldParser::ReadAddress (uint8_t ip[16])
+{
+  SkipSpace ();
+  const char* end = FieldEnd ();
+  // Tunneled packets have one address per ip header, the last one carries tcp
+  const char* begin = end;
+  while (begin > m_pos && begin[-1] != ',')
+    {
+      begin--;
+    }
+  if (begin == end)
+    {
+      Fail ("missing ip address");
+    }
+  std::memset (ip, 0, 16);
+  const char* colon = static_cast<const char*> (std::memchr (begin, ':', end - begin));
+  bool ipv6 = colon != 0;
+  bool valid = ipv6 ? ParseIpv6 (begin, end, ip) : ParseIpv4 (begin, end, ip);
+  if (!valid)
+    {
+      m_pos = begin;
+      Fail (ipv6 ? "malformed IPv6 address" : "malformed IPv4 address");
+    }
+  m_pos = end;
+  return ipv6;
+}
+
+void
+TraceReplayFieldParser::Fail (std::string message) const
+{
+  std::cerr << m_source << ":" << m_lineNum << ":" << (m_pos - m_line) + 1
+            << ": " << message << "\n";
+  exit (1);
+}
+
+} // namespace ns3
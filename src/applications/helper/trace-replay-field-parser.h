@@ -0,0 +1,177 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ */
+
+#ifndef TRACE_REPLAY_FIELD_PARSER_H
+#define TRACE_REPLAY_FIELD_PARSER_H
+
+#include <istream>
+#include <string>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \brief TraceReplayFieldParser reads tab or space separated fields of
+ * a text line, as written in the trace file and printed by tshark.
+ *
+ * Fields are parsed in place, without regular expressions, string
+ * streams or memory allocation per field. Any malformed field is
+ * reported with the source name, line and column, and the program exits.
+ */
+class TraceReplayFieldParser
+{
+public:
+  /**
+   * \param source Name of the input, used in error messages
+   */
+  TraceReplayFieldParser (std::string source);
+
+  /**
+   * \brief Reads the next line which is not a comment (starting with '#')
+   *
+   * \param input Input stream
+   *
+   * \returns False at the end of input
+   */
+  bool ReadLine (std::istream& input);
+
+  /**
+   * \brief Starts parsing a line read by the caller
+   *
+   * \param line Start of the line
+   * \param length Length of the line (trailing new line is ignored)
+   */
+  void SetLine (const char* line, size_t length);
+
+  /**
+   * \brief Checks whether all the fields of the line have been read
+   *
+   * \returns True if only white space is left in the line
+   */
+  bool AtEnd ();
+
+  /**
+   * \brief Reports an error if any field of the line is left unread
+   */
+  void ExpectEnd ();
+
+  /**
+   * \brief Reads a decimal unsigned integer field
+   *
+   * \param max Largest accepted value
+   *
+   * \returns Value of the field
+   */
+  uint64_t ReadUnsigned (uint64_t max);
+
+  /**
+   * \brief Reads a decimal 32 bit unsigned integer field
+   *
+   * \returns Value of the field
+   */
+  uint32_t ReadUint32 ();
+
+  /**
+   * \brief Reads a decimal 16 bit unsigned integer field
+   *
+   * \returns Value of the field
+   */
+  uint16_t ReadUint16 ();
+
+  /**
+   * \brief Reads a hexadecimal unsigned integer field, with optional 0x prefix
+   *
+   * \returns Value of the field
+   */
+  uint32_t ReadHex ();
+
+  /**
+   * \brief Reads a non-negative decimal number (like 0.25 or 5e-05)
+   *
+   * \returns Value of the field
+   */
+  double ReadDouble ();
+
+  /**
+   * \brief Reads an IPv4 (dotted decimal) or IPv6 (hex with colons) address
+   *
+   * When the field has several comma separated addresses (tunnels), the
+   * last one is used.
+   *
+   * \param ip Buffer of 16 bytes to fill in network byte order (IPv4 uses first 4 bytes, rest is 0)
+   *
+   * \returns True if the address is IPv6
+   */
+  bool ReadAddress (uint8_t ip[16]);
+
+  /**
+   * \brief Prints the error with source, line and column and exits
+   *
+   * \param message Error message
+   */
+  void Fail (std::string message) const;
+
+private:
+  /**
+   * \brief Skips the field separators (tabs and spaces)
+   */
+  void SkipSpace ();
+
+  /**
+   * \brief Finds the end of the current field
+   *
+   * \returns Pointer just after the last character of the field
+   */
+  const char* FieldEnd () const;
+
+  /**
+   * \brief Parses an IPv4 address
+   *
+   * \param begin Start of the address
+   * \param end End of the address
+   * \param ip Buffer to fill
+   *
+   * \returns False if the address is malformed
+   */
+  static bool ParseIpv4 (const char* begin, const char* end, uint8_t ip[4]);
+
+  /**
+   * \brief Parses an IPv6 address, with optional "::" and trailing IPv4 part
+   *
+   * \param begin Start of the address
+   * \param end End of the address
+   * \param ip Buffer to fill
+   *
+   * \returns False if the address is malformed
+   */
+  static bool ParseIpv6 (const char* begin, const char* end, uint8_t ip[16]);
+
+  std::string     m_source;         //!< Name of the input
+  std::string     m_buffer;         //!< Line read by ReadLine
+  const char*     m_line;           //!< Start of the current line
+  const char*     m_pos;            //!< Current position in the line
+  const char*     m_end;            //!< End of the current line
+  uint64_t        m_lineNum;        //!< Number of the current line (starting from 1)
+};
+
+} // namespace ns3
+#endif /* TRACE_REPLAY_FIELD_PARSER_H */
@@ -40,7 +40,24 @@
 #include "ns3/trace-replay-utility.h"
 #include "ns3/trace-replay-client.h"
 #include "ns3/trace-replay-server.h"
+#include "ns3/trace-replay-trace.h"
+#include "trace-replay-pcap-reader.h"
+#include "trace-replay-field-parser.h"
 #include "trace-replay-helper.h"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <limits>
 
 namespace ns3 {
 
@@ -52,6 +69,18 @@ TraceReplayHelper::TraceReplayHelper (DataRate dataRate)
   m_startTimeOffset = Seconds (0);
   m_dataRate = dataRate;
   m_portNumber = 49153;
+  m_numThreads = 0;
+  m_streaming = false;
+  m_binaryTrace = false;
+  m_idleTimeout = Seconds (60);
+  m_nextIdleCheck = 0;
+  m_splitClients = false;
+  m_outputDir = ".";
+  m_cacheDir = "trace-replay-cache";
+  m_timeIndex = false;
+  m_maxSegmentSize = 0;
+  m_httpPipe = 0;
+  m_packetPipe = 0;
   m_traceFilePath = "";
   m_pcapPath = "";
 
@@ -65,21 +94,162 @@ TraceReplayHelper::TraceReplayHelper (DataRate dataRate)
 
 TraceReplayHelper::~TraceReplayHelper ()
 {
-  m_connMap.clear ();
-  m_timeoutMap.clear ();
-  m_httpReqMap.clear ();
+  m_conns.clear ();
+  m_connTable.clear ();
+  m_freeConns.clear ();
+  m_connGroups.clear ();
+  m_connGroupMap.clear ();
+  m_clientMap.clear ();
+  m_httpReqFrames.clear ();
   NS_LOG_FUNCTION (this);
 }
 
 bool
 TraceReplayHelper::m_connId::operator< (const m_connId& rhs) const
 {
-  return this->ipClient < rhs.ipClient
-         || (this->ipClient == rhs.ipClient && this->portClient < rhs.portClient)
-         || (this->ipClient == rhs.ipClient && this->portClient == rhs.portClient
-             && this->ipServer < rhs.ipServer)
-         || (this->ipClient == rhs.ipClient && this->portClient == rhs.portClient
-             && this->ipServer == rhs.ipServer && this->portServer < rhs.portServer);
+  // IPv4 connections first, then by client ip, client port, server ip and server port
+  if (this->ipv6 != rhs.ipv6)
+    {
+      return !this->ipv6;
+    }
+  int cmp = std::memcmp (this->ipClient, rhs.ipClient, sizeof (this->ipClient));
+  if (cmp != 0)
+    {
+      return cmp < 0;
+    }
+  if (this->portClient != rhs.portClient)
+    {
+      return this->portClient < rhs.portClient;
+    }
+  cmp = std::memcmp (this->ipServer, rhs.ipServer, sizeof (this->ipServer));
+  if (cmp != 0)
+    {
+      return cmp < 0;
+    }
+  return this->portServer < rhs.portServer;
+}
+
+bool
+TraceReplayHelper::m_connId::operator== (const m_connId& rhs) const
+{
+  return this->portClient == rhs.portClient && this->portServer == rhs.portServer
+         && this->ipv6 == rhs.ipv6
+         && std::memcmp (this->ipClient, rhs.ipClient, sizeof (this->ipClient)) == 0
+         && std::memcmp (this->ipServer, rhs.ipServer, sizeof (this->ipServer)) == 0;
+}
+
+bool
+TraceReplayHelper::m_connId::IsReverse (const m_connId& rhs) const
+{
+  return this->portClient == rhs.portServer && this->portServer == rhs.portClient
+         && this->ipv6 == rhs.ipv6
+         && std::memcmp (this->ipClient, rhs.ipServer, sizeof (this->ipClient)) == 0
+         && std::memcmp (this->ipServer, rhs.ipClient, sizeof (this->ipServer)) == 0;
+}
+
+TraceReplayHelper::m_connId
+TraceReplayHelper::m_connId::Reverse () const
+{
+  m_connId reverse = *this;
+  std::memcpy (reverse.ipClient, this->ipServer, sizeof (reverse.ipClient));
+  std::memcpy (reverse.ipServer, this->ipClient, sizeof (reverse.ipServer));
+  reverse.portClient = this->portServer;
+  reverse.portServer = this->portClient;
+  return reverse;
+}
+
+/**
+ * \brief FNV-1a hash of one end point of a connection
+ *
+ * \param ip Ip address (16 bytes)
+ * \param port Port number
+ *
+ * \returns Hash of the end point
+ */
+static uint64_t
+HashEndPoint (const uint8_t* ip, uint16_t port)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint32_t i = 0; i < 16; i++)
+    {
+      hash = (hash ^ ip[i]) * 1099511628211ULL;
+    }
+  hash = (hash ^ (port & 0xff)) * 1099511628211ULL;
+  hash = (hash ^ (port >> 8)) * 1099511628211ULL;
+  return hash;
+}
+
+uint64_t
+TraceReplayHelper::m_connId::Hash () const
+{
+  // Sum of the end point hashes does not depend on the direction
+  uint64_t hash = HashEndPoint (this->ipClient, this->portClient)
+                  + HashEndPoint (this->ipServer, this->portServer);
+  // Mix the high bits into the low bits used as table index
+  hash ^= hash >> 29;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+/**
+ * \brief Compares connections of a group by their port numbers
+ *
+ * \returns True if (portClient1, portServer1) is less than (portClient2, portServer2)
+ */
+static bool
+PortsLess (uint16_t portClient1, uint16_t portServer1, uint16_t portClient2, uint16_t portServer2)
+{
+  return portClient1 < portClient2 || (portClient1 == portClient2 && portServer1 < portServer2);
+}
+
+/**
+ * \brief Copies the start of a file to a new file
+ *
+ * The kernel copies the data when it can, sharing the blocks of the
+ * file on file systems with reflinks.
+ *
+ * \param from Path of the file to copy
+ * \param to Path of the new file
+ * \param size Number of bytes to copy
+ *
+ * \returns False if the file can not be read or written
+ */
+static bool
+CopyFileStart (std::string from, std::string to, uint64_t size)
+{
+  int in = open (from.c_str (), O_RDONLY);
+  if (in < 0)
+    {
+      return false;
+    }
+  int out = open (to.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out < 0)
+    {
+      close (in);
+      return false;
+    }
+  uint64_t copied = 0;
+#if defined (__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+  ssize_t count;
+  while (copied < size && (count = copy_file_range (in, 0, out, 0, size - copied, 0)) > 0)
+    {
+      copied += count;
+    }
+#endif
+  // Plain copy of the rest, if the file systems can not copy_file_range
+  std::vector<char> buffer (1 << 20);
+  while (copied < size)
+    {
+      ssize_t count = read (in, &buffer[0], std::min<uint64_t> (buffer.size (), size - copied));
+      if (count <= 0 || write (out, &buffer[0], count) != count)
+        {
+          break;
+        }
+      copied += count;
+    }
+  close (in);
+  return close (out) == 0 && copied == size;
 }
 
 void
@@ -118,6 +288,71 @@ TraceReplayHelper::SetStartTimeOffset (Time time)
   m_startTimeOffset = time;
 }
 
+void
+TraceReplayHelper::SetClientSubnet (Ipv4Address network, Ipv4Mask mask)
+{
+  NS_LOG_FUNCTION (this << network << mask);
+  m_filter.subnet = true;
+  m_filter.ipv6 = false;
+  std::memset (m_filter.network, 0, sizeof (m_filter.network));
+  std::memset (m_filter.mask, 0, sizeof (m_filter.mask));
+  Ipv4Address (mask.Get ()).Serialize (m_filter.mask);
+  network.CombineMask (mask).Serialize (m_filter.network);
+}
+
+void
+TraceReplayHelper::SetClientSubnet (Ipv6Address network, Ipv6Prefix prefix)
+{
+  NS_LOG_FUNCTION (this << network);
+  m_filter.subnet = true;
+  m_filter.ipv6 = true;
+  network.Serialize (m_filter.network);
+  std::memset (m_filter.mask, 0, sizeof (m_filter.mask));
+  for (uint32_t i = 0; i < prefix.GetPrefixLength () && i < 128; i++)
+    {
+      m_filter.mask[i / 8] |= 0x80 >> (i % 8);
+    }
+  for (uint32_t i = 0; i < 16; i++)
+    {
+      m_filter.network[i] &= m_filter.mask[i];
+    }
+}
+
+void
+TraceReplayHelper::AddServerPort (uint16_t port)
+{
+  NS_LOG_FUNCTION (this << port);
+  m_filter.serverPorts.resize (65536, false);
+  m_filter.serverPorts[port] = true;
+}
+
+void
+TraceReplayHelper::SetTimeWindow (Time start, Time end)
+{
+  NS_LOG_FUNCTION (this << start << end);
+  if (end < start)
+    {
+      std::cerr << "End of the time window is before its start.\n";
+      exit (1);
+    }
+  m_filter.start = start.GetSeconds ();
+  m_filter.end = end.GetSeconds ();
+}
+
+void
+TraceReplayHelper::SetTimeIndex (bool timeIndex)
+{
+  NS_LOG_FUNCTION (this << timeIndex);
+  m_timeIndex = timeIndex;
+}
+
+void
+TraceReplayHelper::SetMaxSegmentSize (uint32_t mss)
+{
+  NS_LOG_FUNCTION (this << mss);
+  m_maxSegmentSize = mss;
+}
+
 void
 TraceReplayHelper::SetPortNumber (uint16_t port)
 {
@@ -125,6 +360,87 @@ TraceReplayHelper::SetPortNumber (uint16_t port)
   m_portNumber = port;
 }
 
+void
+TraceReplayHelper::SetNumThreads (uint32_t numThreads)
+{
+  NS_LOG_FUNCTION (this);
+  m_numThreads = numThreads;
+}
+
+void
+TraceReplayHelper::SetCacheDirectory (std::string directory)
+{
+  NS_LOG_FUNCTION (this << directory);
+  m_cacheDir = directory;
+}
+
+void
+TraceReplayHelper::SetBinaryTrace (bool binary)
+{
+  NS_LOG_FUNCTION (this << binary);
+  m_binaryTrace = binary;
+}
+
+std::string
+TraceReplayHelper::GetTraceExtension (void) const
+{
+  return m_binaryTrace ? ".bin" : ".txt";
+}
+
+void
+TraceReplayHelper::SetStreaming (bool streaming)
+{
+  NS_LOG_FUNCTION (this << streaming);
+  m_streaming = streaming;
+}
+
+void
+TraceReplayHelper::SetIdleTimeout (Time idleTimeout)
+{
+  NS_LOG_FUNCTION (this);
+  m_idleTimeout = idleTimeout;
+}
+
+FILE*
+TraceReplayHelper::OpenTshark (std::string filter, std::string fields)
+{
+  NS_LOG_FUNCTION (this << filter);
+  // Quote the pcap path for the shell
+  std::string path = "'";
+  for (uint32_t i = 0; i < m_pcapPath.size (); i++)
+    {
+      if (m_pcapPath[i] == '\'')
+        {
+          path += "'\\''";
+        }
+      else
+        {
+          path += m_pcapPath[i];
+        }
+    }
+  path += "'";
+
+  std::string command = "tshark -r " + path + " -Y \"" + filter + "\" -n -T fields " + fields;
+  FILE* pipe = popen (command.c_str (), "r");
+  if (pipe == 0)
+    {
+      std::cerr << "Error running tshark.\n";
+      exit (1);
+    }
+  return pipe;
+}
+
+void
+TraceReplayHelper::CloseTshark (FILE* pipe)
+{
+  NS_LOG_FUNCTION (this);
+  if (pclose (pipe) != 0)
+    {
+      std::cerr << "Error running tshark on input pcap file.\n";
+      exit (1);
+    }
+}
+
 void
 TraceReplayHelper::RunCommands ()
 {
@@ -135,65 +451,90 @@ TraceReplayHelper::RunCommands ()
       exit (1);
     }
 
+  // All the tshark passes run at the same time and their output is
+  // streamed through pipes, nothing is written to the disk.
+
   // Get frame number of all the tcp packets which are also http requests
-  std::string command = "tshark -r " + m_pcapPath + " -Y \"http.request.method and tcp\" -n -T fields -e frame.number > httpRequestFile";
-  system (command.c_str ());
+  m_httpPipe = OpenTshark ("http.request.method and tcp", "-e frame.number");
 
   // Get details about all the tcp packets
-  command = "tshark -r " + m_pcapPath + " -Y \"ip.proto==6 \" -n -T fields -e ip.src -e tcp.srcport -e ip.dst -e tcp.dstport -e tcp.len -e frame.time_relative -e frame.number > tcpPackets.csv";
-  system (command.c_str ());
-
-  // Get tcp timeout details for each packet
-  command = "tshark -r " + m_pcapPath + " -Y \"ip.proto == 6 and tcp.analysis.rto > 0\" -n -T fields -e frame.number -e tcp.analysis.rto > tcpTimeout";
-  system (command.c_str ());
+  // tcp.ack is printed last, as it is empty for packets without ACK flag
+  m_packetPipe = OpenTshark ("ip.proto==6 ", "-e ip.src -e tcp.srcport -e ip.dst -e tcp.dstport -e tcp.len -e frame.time_relative -e frame.number -e tcp.flags -e tcp.seq -e tcp.ack");
 }
 
 void
 TraceReplayHelper::ProcessHttpList ()
 {
   NS_LOG_FUNCTION (this);
-  // Reading httpRequestFile to make a list of frame number of  http requests
-  std::string filename = "httpRequestFile";
-  std::ifstream infile;
-  infile.open (filename.c_str ());
-  if (infile.is_open ())
+  // Reading tshark output to make a list of frame number of http requests
+  uint32_t val;
+  while (fscanf (m_httpPipe, "%u", &val) == 1)
     {
-      uint32_t val;
-      while (infile >> val)
+      if (val >= m_httpReqFrames.size ())
         {
-          m_httpReqMap[val] = true;
+          // tshark prints frames in increasing order, grow geometrically
+          m_httpReqFrames.resize (std::max<size_t> (val + 1, m_httpReqFrames.size () * 2), false);
         }
+      m_httpReqFrames[val] = true;
     }
-  else
-    {
-      std::cerr << "Error opening httpRequestFile file.\n";
-      exit (1);
-    }
-  infile.close ();
+  CloseTshark (m_httpPipe);
+  m_httpPipe = 0;
 }
 
-void
-TraceReplayHelper::ProcessTimeoutList ()
+bool
+TraceReplayHelper::IsTimeout (m_connInfo& conn, bool clientPacket, uint32_t seq, uint32_t ack, uint8_t flags, uint32_t packetSize, double packetTime)
 {
-  NS_LOG_FUNCTION (this);
-  // Reading tcpTimeoutFile file to make a list of timed out packets
-  std::string filename = "tcpTimeout";
-  std::ifstream infile;
-  infile.open (filename.c_str ());
-  if (infile.is_open ())
+  // Sequence and ack state of both the directions of the connection
+  m_tcpState* fwd = clientPacket ? &conn.clientState : &conn.serverState;
+  m_tcpState* rev = clientPacket ? &conn.serverState : &conn.clientState;
+
+  bool syn = flags & 0x02;
+  bool fin = flags & 0x01;
+  bool rst = flags & 0x04;
+  // SYN and FIN take one sequence number each
+  uint32_t seqLength = packetSize + (syn ? 1 : 0) + (fin ? 1 : 0);
+  uint32_t nextSeq = seq + seqLength;
+
+  bool timeOut = false;
+  if (fwd->seqValid && packetSize > 0 && (int32_t) (seq - fwd->nextSeq) < 0)
     {
-      uint32_t val;
-      while (infile >> val)
-        {
-          m_timeoutMap[val] = true;
-        }
+      // Segment starts below the highest sequence number seen so far.
+      // Classify it the same way tshark does for tcp.analysis.rto:
+      // keep-alives, spurious and fast retransmissions and out of order
+      // segments are not timeouts, every other retransmission is.
+      bool keepAlive = packetSize <= 1 && seq == fwd->nextSeq - 1;
+      bool spurious = rev->ackValid && (int32_t) (nextSeq - rev->lastAck) <= 0;
+      bool fastRetransmission = rev->ackValid && rev->dupAckCount >= 2 && rev->lastAck == seq
+                                && packetTime - rev->lastAckTime < 0.02;
+      bool outOfOrder = packetTime - fwd->nextSeqTime < 0.003;
+      timeOut = !keepAlive && !spurious && !fastRetransmission && !outOfOrder;
     }
-  else
+  if (!fwd->seqValid || (int32_t) (nextSeq - fwd->nextSeq) > 0)
     {
-      std::cerr << "Error opening tcpTimeout file.\n";
-      exit (1);
+      fwd->nextSeq = nextSeq;
+      fwd->nextSeqTime = packetTime;
+      fwd->seqValid = true;
+    }
+
+  // Count duplicate acks, used to tell fast retransmissions apart
+  if (flags & 0x10)
+    {
+      if (fwd->ackValid && ack == fwd->lastAck && packetSize == 0 && !syn && !fin && !rst)
+        {
+          fwd->dupAckCount++;
+        }
+      else if (!fwd->ackValid || ack != fwd->lastAck)
+        {
+          fwd->dupAckCount = 0;
+        }
+      if (!fwd->ackValid || (int32_t) (ack - fwd->lastAck) >= 0)
+        {
+          fwd->lastAck = ack;
+        }
+      fwd->lastAckTime = packetTime;
+      fwd->ackValid = true;
     }
-  infile.close ();
+  return timeOut;
 }
 
 double
@@ -225,383 +566,1787 @@ TraceReplayHelper::CalculatePacketDelay (uint32_t frameNum, bool timeOut, bool h
 }
 
 void
-TraceReplayHelper::ProcessPacket (m_connId id, uint32_t packetSize, double packetTime, uint32_t frameNum)
+TraceReplayHelper::ProcessPacket (m_connInfo& conn, bool clientPacket, uint32_t packetSize, double packetTime, uint32_t frameNum, bool timeOut, bool httpReq)
 {
   TraceReplayPacket packet;
   packet.SetSize (packetSize);
 
-  bool clientPacket;
-
-  // If id is present in m_connMap then its Client packet, otherwise Server packet
-  if (m_connMap.find (id) != m_connMap.end ())
+  if (clientPacket)
   {
-    clientPacket = true;
-    if (m_connMap[id].packetC2S)
+    if (conn.packetC2S)
     {
       // last packet in connection was also from client to server
-      m_connMap[id].packetCount += 1;
-      m_connMap[id].byteCount += packetSize;
+      conn.packetCount += 1;
+      conn.byteCount += packetSize;
     }
     else
     {
       // last packet in connection was from server to client.
       // Therefore this packet is a new request.
       // Update server details.
-      m_connMap[id].numRep.push_back (m_connMap[id].packetCount);
-      m_connMap[id].expByteServer.push_back (m_connMap[id].byteCount);
-      m_connMap[id].packetC2S = true;
-      m_connMap[id].packetCount = 1;
-      m_connMap[id].byteCount = packetSize;
+      conn.numRep.push_back (conn.packetCount);
+      conn.expByteServer.push_back (conn.byteCount);
+      conn.packetC2S = true;
+      conn.packetCount = 1;
+      conn.byteCount = packetSize;
     }
   }
   else
   {
-    // packet is from server to client, reverse ip and port
-    Address tmp1 = id.ipClient;
-    id.ipClient = id.ipServer;
-    id.ipServer = tmp1;
-    uint32_t tmp2 = id.portClient;
-    id.portClient = id.portServer;
-    id.portServer = tmp2;
-
-    clientPacket = false;
-    if (!m_connMap[id].packetC2S)
+    // packet is from server to client
+    if (!conn.packetC2S)
     {
-      m_connMap[id].packetCount += 1;
-      m_connMap[id].byteCount += packetSize;
+      conn.packetCount += 1;
+      conn.byteCount += packetSize;
     }
     else
     {
-      m_connMap[id].numReq.push_back (m_connMap[id].packetCount);
-      m_connMap[id].expByteClient.push_back (m_connMap[id].byteCount);
-      m_connMap[id].packetC2S = false;
-      m_connMap[id].packetCount = 1;
-      m_connMap[id].byteCount = packetSize;
+      conn.numReq.push_back (conn.packetCount);
+      conn.expByteClient.push_back (conn.byteCount);
+      conn.packetC2S = false;
+      conn.packetCount = 1;
+      conn.byteCount = packetSize;
     }
   }
 
-  double delay = CalculatePacketDelay (frameNum, m_timeoutMap[frameNum], m_httpReqMap[frameNum],
-                                         (m_connMap[id].currTime).GetSeconds (), packetTime);
+  // Only a packet from client can start a http request
+  double delay = CalculatePacketDelay (frameNum, timeOut, httpReq && clientPacket,
+                                         conn.currTime.GetSeconds (), packetTime);
   packet.SetDelay (Seconds (delay));
   if ((packet.GetDelay ()).IsStrictlyPositive ())
   {
     // delay > 0 seconds
     // Therefore get the list of all parallel connections and total packets sent by so far
-    std::map<m_connId, m_connInfo>::iterator it;
-    for (it = m_connMap.begin (); it != m_connMap.end (); it++)
-    {
-      // A parallel connection is that in which src and dst ips are same
-      // but src and dst port are different.
-      // Ignore the connection if total packet send by it so far is 0
-      if ((it->first).ipClient == id.ipClient && (it->first).ipServer == id.ipServer
-            && ((it->first).portClient != id.portClient || (it->first).portServer != id.portServer)
-            && it->second.totByteCount > 0)
+    // Open and closed connections of the group are both sorted by ports,
+    // merge them so the list is in the same order as trace file
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    const m_connGroup& group = m_connGroups[conn.group];
+    uint32_t i = 0;
+    uint32_t j = 0;
+    while (i < group.open.size () || j < group.closed.size ())
+    {
+      if (j == group.closed.size ()
+            || (i < group.open.size ()
+                && PortsLess (m_conns[group.open[i]].id.portClient, m_conns[group.open[i]].id.portServer,
+                              group.closed[j].portClient, group.closed[j].portServer)))
+      {
+        // A parallel connection is that in which src and dst ips are same
+        // but src and dst port are different.
+        // Ignore the connection if total packet send by it so far is 0
+        const m_connInfo& other = m_conns[group.open[i++]];
+        if (&other != &conn && other.totByteCount > 0)
+        {
+          packet.AddParallelConnection (other.id.portClient, other.id.portServer, other.totByteCount);
+        }
+      }
+      else
       {
-        packet.AddParallelConnection ((it->first).portClient, (it->first).portServer, (it->second).totByteCount);
+        const m_closedConn& other = group.closed[j++];
+        packet.AddParallelConnection (other.portClient, other.portServer, other.totByteCount);
       }
     }
+    m_stats.numParallelLists++;
+    m_stats.numParallelEntries += packet.GetNumParallelConnection ();
+    m_stats.parallelTime += std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
   }
 
   if (clientPacket)
   {
-    m_connMap[id].clientPackets.push_back (packet);
+    conn.clientPackets.push_back (packet);
   }
   else
   {
-    m_connMap[id].serverPackets.push_back (packet);
+    conn.serverPackets.push_back (packet);
   }
 
-  m_connMap[id].currTime = Seconds (packetTime);
+  conn.currTime = Seconds (packetTime);
   // Increament total packet sent by connection so far
-  m_connMap[id].totByteCount += packetSize;
+  conn.totByteCount += packetSize;
 }
 
-void
-TraceReplayHelper::ProcessPacketList ()
+uint32_t
+TraceReplayHelper::FindConnection (const m_connId& id, double packetTime, bool create, bool& clientPacket)
 {
-  // Reading packetFile to get details about each individual packet and map them to a connection
-  std::string filename = "tcpPackets.csv";
-  std::ifstream infile;
-  infile.open (filename.c_str ());
-  if (infile.is_open ())
-    {
-      std::string line;
-      while (std::getline (infile, line))
-        {
-          std::istringstream iss (line);
-          std::string ipSrc;
-          uint16_t portSrc;
-          std::string ipDest;
-          uint16_t portDest;
-          uint32_t packetSize;
-          uint32_t frameNum;
-          double packetTime;
-
-          iss >> ipSrc >> portSrc >> ipDest >> portDest;
-          iss >> packetSize >> packetTime >> frameNum;
-
-          m_connId id;
-          if (std::regex_search (ipSrc.begin (), ipSrc.end (), std::regex ("^[0-9]+[.][0-9]+[.][0-9]+[.][0-9]+$")))
-            {
-              // Ipv4 address
-              id.ipClient = Ipv4Address (ipSrc.c_str ());
-            }
-          else
-            {
-              // Ipv6 address
-              id.ipClient = Ipv6Address (ipSrc.c_str ());
-            }
-          id.portClient = portSrc;
-          if (std::regex_search (ipDest.begin (), ipDest.end (), std::regex ("^[0-9]+[.][0-9]+[.][0-9]+[.][0-9]+$")))
+  if (m_conns.size () * 2 >= m_connTable.size ())
+    {
+      // Keep the load factor below one half, so probe sequences stay short
+      std::vector<uint32_t> table (std::max<size_t> (1024, m_connTable.size () * 2), 0);
+      uint64_t mask = table.size () - 1;
+      for (uint32_t i = 0; i < m_conns.size (); i++)
+        {
+          if (!m_conns[i].open)
             {
-              id.ipServer = Ipv4Address (ipDest.c_str ());
+              continue;
             }
-          else
+          uint64_t slot = m_conns[i].id.Hash () & mask;
+          while (table[slot] != 0)
             {
-              id.ipServer = Ipv6Address (ipDest.c_str ());
+              slot = (slot + 1) & mask;
             }
-          id.portServer = portDest;
-
-          // If the packet is from server to client then ip and port numbers for source and destination will be reversed
-          m_connId idReverse;
-          idReverse.ipClient = id.ipServer;
-          idReverse.portClient = id.portServer;
-          idReverse.ipServer = id.ipClient;
-          idReverse.portServer = id.portClient;
-          // if the ip and port number for packet are not present in map then insert it as new connection
-          if (m_connMap.find (id) == m_connMap.end () && m_connMap.find (idReverse) == m_connMap.end ())
-          {
-            m_connInfo info;
-            info.startTime = Seconds (packetTime);
-            info.packetC2S = true;
-            info.packetCount = 0;
-            info.byteCount = 0;
-            info.currTime = Seconds (packetTime);
-            info.totByteCount = 0;
-            m_connMap[id] = info;
-          }
-
-          if (packetSize == 0)
-          {
-            // ignore 0 byte packets
-            continue;
-          }
-          ProcessPacket (id, packetSize, packetTime, frameNum);
+          table[slot] = i + 1;
         }
+      m_connTable.swap (table);
     }
-  else
-    {
-      std::cerr << "Error opening tcpPackets.csv file.\n";
-      exit (1);
-    }
-  infile.close ();
-}
 
-void
-TraceReplayHelper::PrintTraceFile ()
-{
-  std::ofstream file;
-  file.open ("traceFile.txt");
-  // Comments for trace file
-  file << "# ------------------------------------------------\n";
-  file << "# Trace file: traceFile.txt\n";
-  file << "# File structure:-\n";
-  file << "# Number of client\n";
-  file << "# For each client {\n";
-  file << "# \tNumber of connection\n";
-  file << "# \tFor each connection {\n";
-  file << "# \t\tIp_Client\tPort_Client\tIp_server\tPort_Server\tStart_Time\n";
-  file << "# \t\tNumber of packets from client to server\n";
-  file << "# \t\tFor each packet from client to server {\n";
-  file << "# \t\t\tPacket_Size\tPacket_Delay\n";
-  file << "# \t\t}\n";
-  file << "# \t\tNumber of client request\n";
-  file << "# \t\tFor each request {\n";
-  file << "# \t\t\tNumber of packets to send before going to receive mode\n";
-  file << "# \t\t}\n";
-  file << "# \t\tNumber of server response\n";
-  file << "# \t\tFor each response {\n";
-  file << "# \t\t\tNumber of bytes to receive before going to send mode\n";
-  file << "# \t\t}\n";
-  file << "# \t\tNumber of packet from server to client\n";
-  file << "# \t\tFor each packet from server to client {\n";
-  file << "# \t\t\tPacket_Size\tPacket_Delay\n";
-  file << "# \t\t}\n";
-  file << "# \t\tNumber of server response\n";
-  file << "# \t\tFor each response {\n";
-  file << "# \t\t\tNumber of packets to send before going to receive mode\n";
-  file << "# \t\t}\n";
-  file << "# \t\tNumber of client request\n";
-  file << "# \t\tFor each request {\n";
-  file << "# \t\t\tNumber of bytes to receive before going to send mode\n";
-  file << "# \t\t}\n";
-  file << "# \t}\n";
-  file << "# }\n";
-  file << "# ------------------------------------------------\n";
-  // Print number of connection
-  file << m_connMap.size () << std::endl;
-  // Iterate over each connection and print details
-  std::map<m_connId, m_connInfo>::iterator it;
-  for (it = m_connMap.begin (); it != m_connMap.end (); it++)
+  uint64_t mask = m_connTable.size () - 1;
+  uint64_t slot = id.Hash () & mask;
+  while (m_connTable[slot] != 0)
     {
-      // Update the final packet and byte counts.
-      if (it->second.packetC2S && it->second.totByteCount > 0)
+      uint32_t index = m_connTable[slot] - 1;
+      if (m_conns[index].id == id)
         {
-          it->second.numReq.push_back (it->second.packetCount);
-          it->second.expByteClient.push_back (it->second.byteCount);
+          clientPacket = true;
+          return index;
         }
-      else if (it->second.totByteCount > 0)
+      // If the packet is from server to client then ip and port numbers for source and destination will be reversed
+      if (m_conns[index].id.IsReverse (id))
         {
-          it->second.numRep.push_back (it->second.packetCount);
-          it->second.expByteServer.push_back (it->second.byteCount);
+          clientPacket = false;
+          return index;
         }
+      slot = (slot + 1) & mask;
+    }
+  if (!create)
+    {
+      return NO_CONNECTION;
+    }
 
-      if (Ipv4Address::IsMatchingType ((it->first).ipClient))
-        {
-          file << Ipv4Address::ConvertFrom ((it->first).ipClient) << "\t";
-        }
-      else
-        {
-          file << Ipv6Address::ConvertFrom ((it->first).ipClient) << "\t";
-        }
-      file << (it->first).portClient << "\t";
-      if (Ipv4Address::IsMatchingType ((it->first).ipServer))
-        {
-          file << Ipv4Address::ConvertFrom ((it->first).ipServer) << "\t";
-        }
-      else
-        {
-          file << Ipv6Address::ConvertFrom ((it->first).ipServer) << "\t";
-        }
-      file << (it->first).portServer << "\t";
-      file << (it->second).startTime.GetSeconds () << std::endl;
+  // the ip and port number for packet are not present in table, insert it as new connection
+  m_connInfo info;
+  info.id = id;
+  info.startTime = Seconds (packetTime);
+  info.packetC2S = true;
+  info.packetCount = 0;
+  info.byteCount = 0;
+  info.currTime = Seconds (packetTime);
+  info.totByteCount = 0;
+  info.clientState.seqValid = false;
+  info.clientState.ackValid = false;
+  info.clientState.dupAckCount = 0;
+  info.serverState = info.clientState;
+  info.lastTime = packetTime;
+  info.finClient = false;
+  info.finServer = false;
+  info.open = true;
+  // A connection dropped by the filter is still inserted, so that its later
+  // packets are not taken for a new connection with the other host as client
+  info.filtered = !m_filter.MatchesConnection (id.ipv6, id.ipClient, id.portServer);
+  info.group = 0;
+  info.client = 0;
 
-      uint32_t numPacket = (it->second).clientPackets.size ();
-      file << numPacket << std::endl;
-      for (uint32_t i = 0; i < numPacket; i++)
+  if (!info.filtered)
+    {
+      // Add the connection to its group of parallel connections
+      m_connId groupId = id;
+      groupId.portClient = 0;
+      groupId.portServer = 0;
+      std::map<m_connId, uint32_t>::iterator it = m_connGroupMap.find (groupId);
+      if (it == m_connGroupMap.end ())
         {
-          // print details of each packet
-          TraceReplayPacket packet = (it->second).clientPackets[i];
-          file << packet.GetSize () << "\t" << (packet.GetDelay ()).GetSeconds () << std::endl;
-          if ((packet.GetDelay ()).IsStrictlyPositive ())
-            {
-              uint32_t numParallelCon = packet.GetNumParallelConnection ();
-              file << numParallelCon << std::endl;
-              for (uint32_t j = 0; j < numParallelCon; j++)
-                {
-                  std::pair<uint16_t, uint16_t> connId = packet.GetConnectionId (j);
-                  file << connId.first << "\t" << connId.second << "\t" << packet.GetByteCount (j) << std::endl;
-                }
-            }
+          it = m_connGroupMap.insert (std::make_pair (groupId, m_connGroups.size ())).first;
+          m_connGroups.push_back (m_connGroup ());
         }
+      info.group = it->second;
+      info.client = FindClient (id);
+    }
 
-      uint32_t size = (it->second).numReq.size ();
-      file << size << std::endl;
-      for (uint32_t i = 0; i < size; i++)
-        {
-          file << (it->second).numReq[i] << std::endl;
-        }
+  uint32_t index;
+  if (!m_freeConns.empty ())
+    {
+      index = m_freeConns.back ();
+      m_freeConns.pop_back ();
+      m_conns[index] = info;
+    }
+  else
+    {
+      index = m_conns.size ();
+      m_conns.push_back (info);
+    }
 
-      size = (it->second).expByteServer.size ();
-      file << size << std::endl;
-      for (uint32_t i = 0; i < size; i++)
+  if (!info.filtered)
+    {
+      m_connGroup& group = m_connGroups[info.group];
+      group.open.insert (std::upper_bound (group.open.begin (), group.open.end (), index, [this] (uint32_t a, uint32_t b)
         {
-          file << (it->second).expByteServer[i] << std::endl;
-        }
-
-      numPacket = (it->second).serverPackets.size ();
-      file << numPacket << std::endl;
-      for (uint32_t i = 0; i < numPacket; i++)
+          return m_conns[a].id < m_conns[b].id;
+        }), index);
+      // A closed connection on the same ports is replaced by the new one
+      for (uint32_t i = 0; i < group.closed.size (); i++)
         {
-          // print details of each packet
-          TraceReplayPacket packet = (it->second).serverPackets[i];
-          file << packet.GetSize () << "\t" << (packet.GetDelay ()).GetSeconds () << std::endl;
-          if ((packet.GetDelay ()).IsStrictlyPositive ())
+          if (group.closed[i].portClient == id.portClient && group.closed[i].portServer == id.portServer)
             {
-              uint32_t numParallelCon = packet.GetNumParallelConnection ();
-              file << numParallelCon << std::endl;
-              for (uint32_t j = 0; j < numParallelCon; j++)
-                {
-                  std::pair<uint16_t, uint16_t> connId = packet.GetConnectionId (j);
-                  file << connId.first << "\t" << connId.second << "\t" << packet.GetByteCount (j) << std::endl;
-                }
+              group.closed.erase (group.closed.begin () + i);
+              break;
             }
         }
+    }
 
-      size = (it->second).numRep.size ();
-      file << size << std::endl;
-      for (uint32_t i = 0; i < size; i++)
+  m_connTable[slot] = index + 1;
+  clientPacket = true;
+  return index;
+}
+
+void
+TraceReplayHelper::RemoveConnection (uint32_t index)
+{
+  uint64_t mask = m_connTable.size () - 1;
+  uint64_t slot = m_conns[index].id.Hash () & mask;
+  while (m_connTable[slot] != index + 1)
+    {
+      slot = (slot + 1) & mask;
+    }
+  // Backward shift deletion: move later entries of the probe sequence
+  // into the hole, so that lookups do not stop early at an empty slot
+  uint64_t next = slot;
+  while (true)
+    {
+      next = (next + 1) & mask;
+      if (m_connTable[next] == 0)
+        {
+          break;
+        }
+      uint64_t home = m_conns[m_connTable[next] - 1].id.Hash () & mask;
+      bool movable = slot <= next ? (home <= slot || home > next) : (home <= slot && home > next);
+      if (movable)
+        {
+          m_connTable[slot] = m_connTable[next];
+          slot = next;
+        }
+    }
+  m_connTable[slot] = 0;
+}
+
+void
+TraceReplayHelper::FinalizeConnection (uint32_t index)
+{
+  m_connInfo& conn = m_conns[index];
+  if (!conn.filtered)
+    {
+      m_clientTrace& trace = m_clients[conn.client];
+      PrintConnection (GetTraceFile (conn.client), conn);
+      trace.numPrinted++;
+      trace.numPackets += conn.clientPackets.size () + conn.serverPackets.size ();
+
+      m_connGroup& group = m_connGroups[conn.group];
+      group.open.erase (std::find (group.open.begin (), group.open.end (), index));
+      if (conn.totByteCount > 0)
+        {
+          m_closedConn closed;
+          closed.portClient = conn.id.portClient;
+          closed.portServer = conn.id.portServer;
+          closed.totByteCount = conn.totByteCount;
+          std::vector<m_closedConn>::iterator it = group.closed.begin ();
+          while (it != group.closed.end () && PortsLess (it->portClient, it->portServer, closed.portClient, closed.portServer))
+            {
+              it++;
+            }
+          group.closed.insert (it, closed);
+        }
+    }
+
+  RemoveConnection (index);
+  // Release the packet lists of the connection
+  conn = m_connInfo ();
+  conn.open = false;
+  m_freeConns.push_back (index);
+}
+
+void
+TraceReplayHelper::FinalizeIdleConnections (double packetTime)
+{
+  double limit = packetTime - m_idleTimeout.GetSeconds ();
+  for (uint32_t i = 0; i < m_conns.size (); i++)
+    {
+      if (m_conns[i].open && m_conns[i].lastTime < limit)
+        {
+          FinalizeConnection (i);
+        }
+    }
+}
+
+void
+TraceReplayHelper::ProcessSegment (const m_connId& id, uint32_t seq, uint32_t ack, uint8_t flags, uint32_t packetSize,
+                                   double packetTime, uint32_t frameNum, bool httpReq)
+{
+  if (m_streaming && packetTime >= m_nextIdleCheck)
+    {
+      // Idle connections are looked for a few times per idle timeout
+      FinalizeIdleConnections (packetTime);
+      m_nextIdleCheck = packetTime + m_idleTimeout.GetSeconds () / 4;
+    }
+
+  // In streaming mode a packet without payload does not start a new connection,
+  // as it is usually the last ack of a connection which is already written
+  bool create = !m_streaming || packetSize > 0 || (flags & 0x02);
+  // With one trace file per client, or a filter on the client subnet or
+  // server ports, the host which sent the SYN is the client. If only SYN-ACK
+  // was captured, a new connection is inserted with the destination as
+  // client. Otherwise the first packet's sender is the client.
+  bool synAck = (m_splitClients || m_filter.FiltersClients ()) && (flags & 0x12) == 0x12;
+  bool clientPacket;
+  uint32_t index = FindConnection (synAck ? id.Reverse () : id, packetTime, create, clientPacket);
+  if (index == NO_CONNECTION)
+    {
+      return;
+    }
+  if (synAck)
+    {
+      clientPacket = !clientPacket;
+    }
+  m_connInfo& conn = m_conns[index];
+  conn.lastTime = packetTime;
+  if (!conn.filtered)
+    {
+      m_stats.numSegments++;
+      bool timeOut = IsTimeout (conn, clientPacket, seq, ack, flags, packetSize, packetTime);
+      // ignore 0 byte packets
+      if (packetSize > 0)
+        {
+          // TSO/GRO super-segments are split to mss sized packets. The pieces after
+          // the first have the same time as it, so they are sent without delay.
+          uint32_t size = packetSize;
+          if (m_maxSegmentSize > 0 && size > m_maxSegmentSize)
+            {
+              size = m_maxSegmentSize;
+            }
+          ProcessPacket (conn, clientPacket, size, packetTime, frameNum, timeOut, httpReq);
+          for (uint32_t offset = size; offset < packetSize; offset += size)
+            {
+              ProcessPacket (conn, clientPacket, std::min (size, packetSize - offset), packetTime, frameNum, false, false);
+            }
+        }
+    }
+
+  if (m_streaming)
+    {
+      if (flags & 0x01)
+        {
+          if (clientPacket)
+            {
+              conn.finClient = true;
+            }
+          else
+            {
+              conn.finServer = true;
+            }
+        }
+      if ((flags & 0x04) || (conn.finClient && conn.finServer))
+        {
+          // Connection is closed by RST or FIN from both sides
+          FinalizeConnection (index);
+        }
+    }
+}
+
+void
+TraceReplayHelper::ProcessPacketList ()
+{
+  // Reading tshark output to get details about each individual packet and map them to a connection
+  NS_LOG_FUNCTION (this);
+  TraceReplayFieldParser parser ("tshark output");
+  char* buffer = 0;
+  size_t length = 0;
+  ssize_t lineLength;
+  while ((lineLength = getline (&buffer, &length, m_packetPipe)) != -1)
+    {
+      parser.SetLine (buffer, lineLength);
+
+      m_connId id;
+      id.ipv6 = parser.ReadAddress (id.ipClient);
+      id.portClient = parser.ReadUint16 ();
+      if (parser.ReadAddress (id.ipServer) != id.ipv6)
+        {
+          parser.Fail ("source and destination ip addresses are of different types");
+        }
+      id.portServer = parser.ReadUint16 ();
+      uint32_t packetSize = parser.ReadUint32 ();
+      double packetTime = parser.ReadDouble ();
+      uint32_t frameNum = parser.ReadUint32 ();
+      uint32_t flags = parser.ReadHex ();
+      uint32_t seq = parser.ReadUint32 ();
+      // tcp.ack is empty for packets without ACK flag
+      uint32_t ack = parser.AtEnd () ? 0 : parser.ReadUint32 ();
+      parser.ExpectEnd ();
+      if (!m_filter.MatchesTime (packetTime)
+          || !m_filter.MatchesFlow (id.ipv6, id.ipClient, id.ipServer, id.portClient, id.portServer))
+        {
+          continue;
+        }
+      packetTime -= m_filter.start;
+
+      bool httpReq = frameNum < m_httpReqFrames.size () && m_httpReqFrames[frameNum];
+      ProcessSegment (id, seq, ack, flags, packetSize, packetTime, frameNum, httpReq);
+    }
+  free (buffer);
+  CloseTshark (m_packetPipe);
+  m_packetPipe = 0;
+}
+
+void
+TraceReplayHelper::ProcessPcap (TraceReplayPcapReader& reader)
+{
+  NS_LOG_FUNCTION (this);
+  reader.SetFilter (m_filter);
+  if (m_timeIndex)
+    {
+      reader.UseTimeIndex (m_pcapPath + ".tridx");
+    }
+  uint32_t numThreads = m_numThreads;
+  if (numThreads == 0)
+    {
+      numThreads = std::thread::hardware_concurrency ();
+    }
+  if (numThreads > 1 && reader.CanSplit ())
+    {
+      ProcessPcapParallel (reader, numThreads);
+      return;
+    }
+
+  // Single pass over the pcap, each tcp segment is mapped to a connection as soon as it is decoded.
+  // Compressed pcaps are decompressed by another process while this thread decodes.
+  TraceReplayPcapRecord record;
+  while (reader.ReadNext (record))
+    {
+      m_connId id;
+      std::memcpy (id.ipClient, record.ipSrc, sizeof (id.ipClient));
+      std::memcpy (id.ipServer, record.ipDst, sizeof (id.ipServer));
+      id.portClient = record.portSrc;
+      id.portServer = record.portDst;
+      id.ipv6 = record.ipv6;
+
+      ProcessSegment (id, record.seq, record.ack, record.flags, record.payloadSize,
+                      record.time, record.frameNum, record.httpRequest);
+    }
+  reader.Close ();
+}
+
+void
+TraceReplayHelper::ProcessPcapParallel (TraceReplayPcapReader& reader, uint32_t numThreads)
+{
+  NS_LOG_FUNCTION (this << numThreads);
+  // Few chunks per thread, so that a slow chunk does not stall the others
+  std::vector<TraceReplayPcapChunk> chunks;
+  reader.Split (numThreads * 4, chunks);
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<bool> decoded (chunks.size (), false);
+  uint32_t nextChunk = 0;       // next chunk to be picked by a worker
+  uint32_t mergedChunks = 0;    // chunks already merged by this thread
+  // Workers may run ahead of the merge only by a bounded number of chunks
+  uint32_t maxAhead = 2 * numThreads;
+
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < numThreads; i++)
+    {
+      workers.push_back (std::thread ([&] ()
+        {
+          while (true)
+            {
+              uint32_t index;
+              {
+                std::unique_lock<std::mutex> lock (mutex);
+                while (nextChunk < chunks.size () && nextChunk >= mergedChunks + maxAhead)
+                  {
+                    cond.wait (lock);
+                  }
+                if (nextChunk >= chunks.size ())
+                  {
+                    return;
+                  }
+                index = nextChunk++;
+              }
+              reader.DecodeChunk (chunks[index]);
+              {
+                std::lock_guard<std::mutex> lock (mutex);
+                decoded[index] = true;
+              }
+              cond.notify_all ();
+            }
+        }));
+    }
+
+  // Merge the chunks in frame order
+  for (uint32_t i = 0; i < chunks.size (); i++)
+    {
+      {
+        std::unique_lock<std::mutex> lock (mutex);
+        while (!decoded[i])
+          {
+            cond.wait (lock);
+          }
+      }
+
+      // Partial flow table of the chunk, converted to m_connId once per flow
+      std::vector<m_connId> ids (chunks[i].flows.size ());
+      for (uint32_t j = 0; j < chunks[i].flows.size (); j++)
+        {
+          TraceReplayPcapFlow& flow = chunks[i].flows[j];
+          std::memcpy (ids[j].ipClient, flow.ipSrc, sizeof (ids[j].ipClient));
+          std::memcpy (ids[j].ipServer, flow.ipDst, sizeof (ids[j].ipServer));
+          ids[j].portClient = flow.portSrc;
+          ids[j].portServer = flow.portDst;
+          ids[j].ipv6 = flow.ipv6;
+        }
+
+      std::vector<TraceReplayPcapSegment>::iterator it;
+      for (it = chunks[i].segments.begin (); it != chunks[i].segments.end (); it++)
+        {
+          ProcessSegment (ids[it->flow], it->seq, it->ack, it->flags, it->payloadSize,
+                          it->time, it->frameNum, it->httpRequest);
+        }
+
+      // Free the memory of the merged chunk
+      std::vector<TraceReplayPcapFlow> ().swap (chunks[i].flows);
+      std::vector<TraceReplayPcapSegment> ().swap (chunks[i].segments);
+      {
+        std::lock_guard<std::mutex> lock (mutex);
+        mergedChunks++;
+      }
+      cond.notify_all ();
+    }
+
+  for (uint32_t i = 0; i < workers.size (); i++)
+    {
+      workers[i].join ();
+    }
+}
+
+uint32_t
+TraceReplayHelper::FindClient (const m_connId& id)
+{
+  if (!m_splitClients)
+    {
+      return 0;
+    }
+  m_connId clientId = id;
+  std::memset (clientId.ipServer, 0, sizeof (clientId.ipServer));
+  clientId.portClient = 0;
+  clientId.portServer = 0;
+  std::map<m_connId, uint32_t>::iterator it = m_clientMap.find (clientId);
+  if (it != m_clientMap.end ())
+    {
+      return it->second;
+    }
+
+  std::ostringstream ip;
+  if (id.ipv6)
+    {
+      ip << Ipv6Address::Deserialize (id.ipClient);
+    }
+  else
+    {
+      ip << Ipv4Address::Deserialize (id.ipClient);
+    }
+  // ':' of ipv6 addresses is not allowed in file names on every file system
+  std::string address = ip.str ();
+  std::replace (address.begin (), address.end (), ':', '-');
+  m_clientTrace trace;
+  trace.name = "traceFile-" + address + GetTraceExtension ();
+  trace.file = 0;
+  trace.numPrinted = 0;
+  trace.numPackets = 0;
+  trace.created = false;
+  m_clients.push_back (trace);
+  m_clientMap[clientId] = m_clients.size () - 1;
+  if (m_streaming)
+    {
+      // Connections of the client are written as soon as they are closed
+      GetTraceFile (m_clients.size () - 1);
+    }
+  return m_clients.size () - 1;
+}
+
+std::ofstream&
+TraceReplayHelper::GetTraceFile (uint32_t client)
+{
+  m_clientTrace& trace = m_clients[client];
+  if (!m_splitClients)
+    {
+      return *trace.file;
+    }
+  if (trace.file != 0)
+    {
+      m_openTraces.splice (m_openTraces.begin (), m_openTraces, trace.lruPos);
+      return *trace.file;
+    }
+  // A capture can have more clients than the process can open files
+  if (m_openTraces.size () >= MAX_OPEN_TRACE_FILES)
+    {
+      SuspendTraceFile (m_clients[m_openTraces.back ()]);
+      m_openTraces.pop_back ();
+    }
+  if (trace.created)
+    {
+      ReopenTraceFile (trace);
+    }
+  else
+    {
+      OpenTraceFile (trace);
+    }
+  m_openTraces.push_front (client);
+  trace.lruPos = m_openTraces.begin ();
+  return *trace.file;
+}
+
+void
+TraceReplayHelper::ReopenTraceFile (m_clientTrace& trace)
+{
+  // Opened for update, as the count at the start is written when the file is closed
+  std::ios::openmode mode = std::ios::in | std::ios::out | std::ios::binary;
+  trace.file = new std::ofstream ((m_scratchDir + "/" + trace.name).c_str (), mode);
+  if (!trace.file->is_open ())
+    {
+      std::cerr << "Error opening trace file.\n";
+      exit (1);
+    }
+  trace.file->seekp (0, std::ios::end);
+}
+
+void
+TraceReplayHelper::SuspendTraceFile (m_clientTrace& trace)
+{
+  trace.file->close ();
+  if (trace.file->fail ())
+    {
+      std::cerr << "Error writing trace file.\n";
+      exit (1);
+    }
+  delete trace.file;
+  trace.file = 0;
+}
+
+void
+TraceReplayHelper::OpenTraceFile (m_clientTrace& trace)
+{
+  std::ios::openmode mode = m_binaryTrace ? std::ios::out | std::ios::binary : std::ios::out;
+  trace.file = new std::ofstream ((m_scratchDir + "/" + trace.name).c_str (), mode);
+  if (!trace.file->is_open ())
+    {
+      std::cerr << "Error creating trace file.\n";
+      exit (1);
+    }
+  trace.created = true;
+  std::ofstream& file = *trace.file;
+  if (m_binaryTrace)
+    {
+      // Header is written again with the counts when the file is closed
+      std::string header;
+      TraceReplayTrace::WriteHeader (header, 0, 0);
+      trace.countPos = 0;
+      file.write (header.data (), header.size ());
+      return;
+    }
+  // Comments for trace file
+  file << "# ------------------------------------------------\n";
+  file << "# Trace file: " << trace.name << "\n";
+  file << "# File structure:-\n";
+  file << "# Number of client\n";
+  file << "# For each client {\n";
+  file << "# \tNumber of connection\n";
+  file << "# \tFor each connection {\n";
+  file << "# \t\tIp_Client\tPort_Client\tIp_server\tPort_Server\tStart_Time\n";
+  file << "# \t\tNumber of packets from client to server\n";
+  file << "# \t\tFor each packet from client to server {\n";
+  file << "# \t\t\tPacket_Size\tPacket_Delay\n";
+  file << "# \t\t}\n";
+  file << "# \t\tNumber of client request\n";
+  file << "# \t\tFor each request {\n";
+  file << "# \t\t\tNumber of packets to send before going to receive mode\n";
+  file << "# \t\t}\n";
+  file << "# \t\tNumber of server response\n";
+  file << "# \t\tFor each response {\n";
+  file << "# \t\t\tNumber of bytes to receive before going to send mode\n";
+  file << "# \t\t}\n";
+  file << "# \t\tNumber of packet from server to client\n";
+  file << "# \t\tFor each packet from server to client {\n";
+  file << "# \t\t\tPacket_Size\tPacket_Delay\n";
+  file << "# \t\t}\n";
+  file << "# \t\tNumber of server response\n";
+  file << "# \t\tFor each response {\n";
+  file << "# \t\t\tNumber of packets to send before going to receive mode\n";
+  file << "# \t\t}\n";
+  file << "# \t\tNumber of client request\n";
+  file << "# \t\tFor each request {\n";
+  file << "# \t\t\tNumber of bytes to receive before going to send mode\n";
+  file << "# \t\t}\n";
+  file << "# \t}\n";
+  file << "# }\n";
+  file << "# ------------------------------------------------\n";
+  if (m_streaming)
+    {
+      // Number of connections is known only at the end. Reserve the widest
+      // count, leading zeros are allowed in the trace file.
+      trace.countPos = file.tellp ();
+      file << "0000000000" << std::endl;
+    }
+}
+
+void
+TraceReplayHelper::CloseTraceFile (m_clientTrace& trace)
+{
+  std::ofstream& file = *trace.file;
+  if (m_binaryTrace)
+    {
+      std::string header;
+      TraceReplayTrace::WriteHeader (header, trace.numPrinted, trace.numPackets);
+      file.seekp (trace.countPos);
+      file.write (header.data (), header.size ());
+    }
+  else if (m_streaming)
+    {
+      file.seekp (trace.countPos);
+      file << std::setw (10) << std::setfill ('0') << trace.numPrinted;
+    }
+  SuspendTraceFile (trace);
+}
+
+void
+TraceReplayHelper::PrintConnection (std::ostream& file, m_connInfo& conn)
+{
+  // Update the final packet and byte counts.
+  if (conn.packetC2S && conn.totByteCount > 0)
+    {
+      conn.numReq.push_back (conn.packetCount);
+      conn.expByteClient.push_back (conn.byteCount);
+    }
+  else if (conn.totByteCount > 0)
+    {
+      conn.numRep.push_back (conn.packetCount);
+      conn.expByteServer.push_back (conn.byteCount);
+    }
+  if (m_binaryTrace)
+    {
+      // Whole connection is written at once
+      std::string record;
+      WriteBinaryConnection (record, conn);
+      file.write (record.data (), record.size ());
+      return;
+    }
+
+  if (conn.id.ipv6)
+    {
+      file << Ipv6Address (conn.id.ipClient) << "\t";
+    }
+  else
+    {
+      file << Ipv4Address::Deserialize (conn.id.ipClient) << "\t";
+    }
+  file << conn.id.portClient << "\t";
+  if (conn.id.ipv6)
+    {
+      file << Ipv6Address (conn.id.ipServer) << "\t";
+    }
+  else
+    {
+      file << Ipv4Address::Deserialize (conn.id.ipServer) << "\t";
+    }
+  file << conn.id.portServer << "\t";
+  file << conn.startTime.GetSeconds () << std::endl;
+
+  uint32_t numPacket = conn.clientPackets.size ();
+  file << numPacket << std::endl;
+  for (uint32_t i = 0; i < numPacket; i++)
+    {
+      // print details of each packet
+      TraceReplayPacket packet = conn.clientPackets[i];
+      file << packet.GetSize () << "\t" << (packet.GetDelay ()).GetSeconds () << std::endl;
+      if ((packet.GetDelay ()).IsStrictlyPositive ())
+        {
+          uint32_t numParallelCon = packet.GetNumParallelConnection ();
+          file << numParallelCon << std::endl;
+          for (uint32_t j = 0; j < numParallelCon; j++)
+            {
+              std::pair<uint16_t, uint16_t> connId = packet.GetConnectionId (j);
+              file << connId.first << "\t" << connId.second << "\t" << packet.GetByteCount (j) << std::endl;
+            }
+        }
+    }
+
+  uint32_t size = conn.numReq.size ();
+  file << size << std::endl;
+  for (uint32_t i = 0; i < size; i++)
+    {
+      file << conn.numReq[i] << std::endl;
+    }
+
+  size = conn.expByteServer.size ();
+  file << size << std::endl;
+  for (uint32_t i = 0; i < size; i++)
+    {
+      file << conn.expByteServer[i] << std::endl;
+    }
+
+  numPacket = conn.serverPackets.size ();
+  file << numPacket << std::endl;
+  for (uint32_t i = 0; i < numPacket; i++)
+    {
+      // print details of each packet
+      TraceReplayPacket packet = conn.serverPackets[i];
+      file << packet.GetSize () << "\t" << (packet.GetDelay ()).GetSeconds () << std::endl;
+      if ((packet.GetDelay ()).IsStrictlyPositive ())
+        {
+          uint32_t numParallelCon = packet.GetNumParallelConnection ();
+          file << numParallelCon << std::endl;
+          for (uint32_t j = 0; j < numParallelCon; j++)
+            {
+              std::pair<uint16_t, uint16_t> connId = packet.GetConnectionId (j);
+              file << connId.first << "\t" << connId.second << "\t" << packet.GetByteCount (j) << std::endl;
+            }
+        }
+    }
+
+  size = conn.numRep.size ();
+  file << size << std::endl;
+  for (uint32_t i = 0; i < size; i++)
+    {
+      file << conn.numRep[i] << std::endl;
+    }
+
+  size = conn.expByteClient.size ();
+  file << size << std::endl;
+  for (uint32_t i = 0; i < size; i++)
+    {
+      file << conn.expByteClient[i] << std::endl;
+    }
+}
+
+void
+TraceReplayHelper::WriteBinaryConnection (std::string& buffer, const m_connInfo& conn)
+{
+  TraceReplayTrace::WriteConnection (buffer, conn.id.ipClient, conn.id.portClient, conn.id.ipServer, conn.id.portServer,
+                                     conn.id.ipv6, conn.startTime, conn.clientPackets, conn.numReq, conn.expByteServer,
+                                     conn.serverPackets, conn.numRep, conn.expByteClient);
+}
+
+void
+TraceReplayHelper::PrintTraceFile ()
+{
+  // Connections still open are printed in the order of their ip and port
+  // numbers, not in the order they were found
+  std::vector<std::vector<uint32_t> > order (m_clients.size ());
+  for (uint32_t i = 0; i < m_conns.size (); i++)
+    {
+      if (m_conns[i].open && !m_conns[i].filtered)
+        {
+          order[m_conns[i].client].push_back (i);
+        }
+    }
+
+  // Trace files kept open while streaming are opened again by the thread writing them
+  if (m_splitClients)
+    {
+      for (std::list<uint32_t>::iterator it = m_openTraces.begin (); it != m_openTraces.end (); it++)
+        {
+          SuspendTraceFile (m_clients[*it]);
+        }
+      m_openTraces.clear ();
+    }
+
+  // Each trace file is written by one thread, connections of a client are not shared
+  std::mutex mutex;
+  uint32_t nextClient = 0;
+  std::function<void ()> printClients = [&] ()
+    {
+      while (true)
+        {
+          uint32_t c;
+          {
+            std::lock_guard<std::mutex> lock (mutex);
+            if (nextClient >= m_clients.size ())
+              {
+                return;
+              }
+            c = nextClient++;
+          }
+          std::sort (order[c].begin (), order[c].end (), [this] (uint32_t a, uint32_t b)
+            {
+              return m_conns[a].id < m_conns[b].id;
+            });
+          m_clientTrace& trace = m_clients[c];
+          if (m_streaming && trace.file == 0)
+            {
+              ReopenTraceFile (trace);
+            }
+          else if (!m_streaming)
+            {
+              OpenTraceFile (trace);
+              if (!m_binaryTrace)
+                {
+                  // Print number of connection
+                  *trace.file << order[c].size () << std::endl;
+                }
+            }
+          // Iterate over each connection and print details
+          for (uint32_t i = 0; i < order[c].size (); i++)
+            {
+              PrintConnection (*trace.file, m_conns[order[c][i]]);
+              trace.numPrinted++;
+              trace.numPackets += m_conns[order[c][i]].clientPackets.size () + m_conns[order[c][i]].serverPackets.size ();
+            }
+          CloseTraceFile (trace);
+        }
+    };
+
+  uint32_t numThreads = m_numThreads;
+  if (numThreads == 0)
+    {
+      numThreads = std::thread::hardware_concurrency ();
+    }
+  numThreads = std::min<uint32_t> (numThreads, m_clients.size ());
+  std::vector<std::thread> workers;
+  for (uint32_t i = 1; i < numThreads; i++)
+    {
+      workers.push_back (std::thread (printClients));
+    }
+  printClients ();
+  for (uint32_t i = 0; i < workers.size (); i++)
+    {
+      workers[i].join ();
+    }
+  for (uint32_t i = 0; i < m_clients.size (); i++)
+    {
+      m_stats.numConnections += m_clients[i].numPrinted;
+    }
+}
+
+void
+TraceReplayHelper::CreateScratchDir ()
+{
+  NS_LOG_FUNCTION (this);
+  // Unique directory for this conversion, in the output directory so that
+  // the trace files can be renamed into it
+  std::string pattern = m_outputDir + "/trace-replay-XXXXXX";
+  std::vector<char> dir (pattern.begin (), pattern.end ());
+  dir.push_back ('\0');
+  if (mkdtemp (&dir[0]) == 0)
+    {
+      std::cerr << "Error creating scratch directory.\n";
+      exit (1);
+    }
+  m_scratchDir = &dir[0];
+}
+
+void
+TraceReplayHelper::DeleteTmpFiles ()
+{
+  NS_LOG_FUNCTION (this);
+  // Publish the trace files in the output directory, replacing any older
+  // ones atomically, and remove the scratch directory
+  for (uint32_t i = 0; i < m_clients.size (); i++)
+    {
+      std::string traceFile = m_scratchDir + "/" + m_clients[i].name;
+      if (std::rename (traceFile.c_str (), (m_outputDir + "/" + m_clients[i].name).c_str ()) != 0)
+        {
+          std::remove (traceFile.c_str ());
+        }
+    }
+  rmdir (m_scratchDir.c_str ());
+  m_scratchDir = "";
+}
+
+/**
+ * \brief Resets the peak RSS of the process to its current RSS
+ *
+ * Only supported by Linux (/proc/self/clear_refs). Elsewhere the peak RSS
+ * stays the peak of the process since it started.
+ */
+static void
+ResetPeakRss (void)
+{
+  std::ofstream file ("/proc/self/clear_refs");
+  file << "5";
+}
+
+/**
+ * \brief Returns the peak RSS of the process since it started or since ResetPeakRss
+ *
+ * \returns Peak RSS (KB)
+ */
+static uint64_t
+GetPeakRss (void)
+{
+  std::ifstream file ("/proc/self/status");
+  std::string line;
+  while (std::getline (file, line))
+    {
+      if (line.compare (0, 6, "VmHWM:") == 0)
+        {
+          return std::strtoull (line.c_str () + 6, 0, 10);
+        }
+    }
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void
+TraceReplayHelper::StartStage (std::chrono::steady_clock::time_point& start)
+{
+  ResetPeakRss ();
+  start = std::chrono::steady_clock::now ();
+}
+
+void
+TraceReplayHelper::EndStage (std::chrono::steady_clock::time_point& start, double& time, uint64_t& rss)
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now ();
+  time = std::chrono::duration<double> (now - start).count ();
+  rss = GetPeakRss ();
+  // Next stage starts now, with its own peak
+  ResetPeakRss ();
+  start = std::chrono::steady_clock::now ();
+}
+
+TraceReplayConversionStats
+TraceReplayHelper::GetConversionStats (void) const
+{
+  return m_stats;
+}
+
+void
+TraceReplayHelper::ClearConversion ()
+{
+  m_conns.clear ();
+  m_connTable.clear ();
+  m_freeConns.clear ();
+  m_connGroups.clear ();
+  m_connGroupMap.clear ();
+  m_clients.clear ();
+  m_clientMap.clear ();
+  m_openTraces.clear ();
+  m_httpReqFrames.clear ();
+  m_nextIdleCheck = 0;
+  m_stats = TraceReplayConversionStats ();
+  struct stat st;
+  if (stat (m_pcapPath.c_str (), &st) == 0)
+    {
+      m_stats.pcapSize = st.st_size;
+    }
+}
+
+void
+TraceReplayHelper::ConvertPcapToTrace ()
+{
+  // State of any earlier conversion by this helper
+  ClearConversion ();
+
+  CreateScratchDir ();
+  if (!m_splitClients)
+    {
+      // All the connections go to a single trace file
+      m_clientTrace trace;
+      trace.name = "traceFile" + GetTraceExtension ();
+      trace.file = 0;
+      trace.numPrinted = 0;
+      trace.numPackets = 0;
+      trace.created = false;
+      m_clients.push_back (trace);
+      if (m_streaming)
+        {
+          OpenTraceFile (m_clients.back ());
+        }
+    }
+
+  std::chrono::steady_clock::time_point start;
+  StartStage (start);
+  TraceReplayPcapReader reader;
+  if (reader.Open (m_pcapPath))
+    {
+      // tcp packets are decoded and classified in-process, tshark is not needed
+      ProcessPcap (reader);
+    }
+  else
+    {
+      NS_LOG_INFO ("Pcap format is not supported by TraceReplayPcapReader, using tshark");
+      RunCommands ();
+      ProcessHttpList ();
+      ProcessPacketList ();
+    }
+  EndStage (start, m_stats.trackTime, m_stats.trackRss);
+  PrintTraceFile ();
+  EndStage (start, m_stats.writeTime, m_stats.writeRss);
+}
+
+void
+TraceReplayHelper::ConvertPcap (std::string traceFile)
+{
+  NS_LOG_FUNCTION (this << traceFile);
+  if (!std::ifstream (m_pcapPath.c_str ()))
+    {
+      std::cerr << "No valid pcap file.\n";
+      exit (1);
+    }
+  // Scratch directory must be on the same file system as the trace file
+  std::string::size_type slash = traceFile.rfind ('/');
+  m_outputDir = slash == std::string::npos ? "." : traceFile.substr (0, std::max<std::string::size_type> (slash, 1));
+  ConvertPcapToTrace ();
+  std::string converted = m_scratchDir + "/" + m_clients[0].name;
+  if (std::rename (converted.c_str (), traceFile.c_str ()) != 0)
+    {
+      std::cerr << "Error writing trace file " << traceFile << ".\n";
+      exit (1);
+    }
+  DeleteTmpFiles ();
+  m_outputDir = ".";
+}
+
+void
+TraceReplayHelper::AppendPcap (std::string traceFile)
+{
+  NS_LOG_FUNCTION (this << traceFile);
+  if (!std::ifstream (m_pcapPath.c_str ()))
+    {
+      std::cerr << "No valid pcap file.\n";
+      exit (1);
+    }
+  if (m_filter.start > 0 || m_filter.end != std::numeric_limits<double>::infinity ())
+    {
+      std::cerr << "A time window can not be used when appending to a trace file.\n";
+      exit (1);
+    }
+  TraceReplayPcapReader reader;
+  if (!reader.Open (m_pcapPath))
+    {
+      std::cerr << "Pcap format is not supported for appending to a trace file.\n";
+      exit (1);
+    }
+
+  std::string::size_type slash = traceFile.rfind ('/');
+  m_outputDir = slash == std::string::npos ? "." : traceFile.substr (0, std::max<std::string::size_type> (slash, 1));
+  ClearConversion ();
+  m_clientTrace trace;
+  trace.name = slash == std::string::npos ? traceFile : traceFile.substr (slash + 1);
+  trace.file = 0;
+  trace.numPrinted = 0;
+  trace.numPackets = 0;
+  trace.created = false;
+  m_clients.push_back (trace);
+  // Closed connections are written as soon as possible, only the open ones are kept in the state.
+  // Times of the time index would be relative to the segment instead of the first segment.
+  bool streaming = m_streaming;
+  bool timeIndex = m_timeIndex;
+  m_streaming = true;
+  m_timeIndex = false;
+
+  std::string statePath = traceFile + ".state";
+  uint64_t closedEnd;
+  bool resumed = LoadAppendState (statePath, reader, closedEnd);
+  CreateScratchDir ();
+  if (resumed)
+    {
+      // Connections which were still open are at the end of the trace file, they are
+      // written again when closed. The trace file is not changed in place, as a replay
+      // may have it mapped (see TraceReplayTrace): its first closedEnd bytes are copied
+      // to the scratch directory, and the copy replaces it once complete.
+      m_clientTrace& current = m_clients[0];
+      std::string converted = m_scratchDir + "/" + current.name;
+      if (!CopyFileStart (traceFile, converted, closedEnd))
+        {
+          std::cerr << "Error copying trace file " << traceFile << ".\n";
+          exit (1);
+        }
+      current.file = new std::ofstream (converted.c_str (), std::ios::in | std::ios::out);
+      if (!current.file->is_open ())
+        {
+          std::cerr << "Error opening trace file " << converted << ".\n";
+          exit (1);
+        }
+      current.created = true;
+      current.file->seekp (closedEnd);
+    }
+  else
+    {
+      OpenTraceFile (m_clients[0]);
+    }
+
+  std::chrono::steady_clock::time_point start;
+  StartStage (start);
+  ProcessPcap (reader);
+  EndStage (start, m_stats.trackTime, m_stats.trackRss);
+  std::string stateTmp = statePath + ".tmp";
+  SaveAppendState (stateTmp, reader, m_clients[0].file->tellp ());
+  EndStage (start, m_stats.stateTime, m_stats.stateRss);
+  PrintTraceFile ();
+  EndStage (start, m_stats.writeTime, m_stats.writeRss);
+  std::string converted = m_scratchDir + "/" + m_clients[0].name;
+  if (std::rename (converted.c_str (), traceFile.c_str ()) != 0)
+    {
+      std::cerr << "Error writing trace file " << traceFile << ".\n";
+      exit (1);
+    }
+  DeleteTmpFiles ();
+  // State is published only once the trace file is complete
+  if (std::rename (stateTmp.c_str (), statePath.c_str ()) != 0)
+    {
+      std::cerr << "Error writing state file " << statePath << ".\n";
+      exit (1);
+    }
+  m_streaming = streaming;
+  m_timeIndex = timeIndex;
+  m_outputDir = ".";
+}
+
+std::vector<std::string>
+TraceReplayHelper::ConvertPcapPerClient (std::string directory)
+{
+  NS_LOG_FUNCTION (this << directory);
+  if (!std::ifstream (m_pcapPath.c_str ()))
+    {
+      std::cerr << "No valid pcap file.\n";
+      exit (1);
+    }
+  m_splitClients = true;
+  m_outputDir = directory;
+  ConvertPcapToTrace ();
+
+  // m_clientMap is ordered by client ip
+  std::vector<std::string> traceFiles;
+  std::map<m_connId, uint32_t>::iterator it;
+  for (it = m_clientMap.begin (); it != m_clientMap.end (); it++)
+    {
+      traceFiles.push_back (directory + "/" + m_clients[it->second].name);
+    }
+  DeleteTmpFiles ();
+  m_splitClients = false;
+  m_outputDir = ".";
+  return traceFiles;
+}
+
+// Version of the state file written by AppendPcap
+static const uint32_t APPEND_STATE_VERSION = 5;
+
+bool
+TraceReplayHelper::LoadAppendState (std::string path, TraceReplayPcapReader& reader, uint64_t& closedEnd)
+{
+  NS_LOG_FUNCTION (this << path);
+  std::ifstream file (path.c_str ());
+  if (!file.is_open ())
+    {
+      return false;
+    }
+
+  std::function<void (m_connId&)> readId = [&file] (m_connId& id)
+    {
+      std::string client;
+      std::string server;
+      file >> id.ipv6 >> client >> id.portClient >> server >> id.portServer;
+      for (uint32_t i = 0; i < 16 && client.size () == 32 && server.size () == 32; i++)
+        {
+          id.ipClient[i] = std::strtoul (client.substr (2 * i, 2).c_str (), 0, 16);
+          id.ipServer[i] = std::strtoul (server.substr (2 * i, 2).c_str (), 0, 16);
+        }
+      if (client.size () != 32 || server.size () != 32)
+        {
+          file.setstate (std::ios::failbit);
+        }
+    };
+  std::function<void (m_tcpState&)> readState = [&file] (m_tcpState& state)
+    {
+      file >> state.seqValid >> state.nextSeq >> state.nextSeqTime >> state.ackValid
+           >> state.lastAck >> state.dupAckCount >> state.lastAckTime;
+    };
+  std::function<void (std::vector<TraceReplayPacket>&)> readPackets = [&file] (std::vector<TraceReplayPacket>& packets)
+    {
+      uint32_t numPackets = 0;
+      file >> numPackets;
+      for (uint32_t i = 0; i < numPackets && file; i++)
+        {
+          TraceReplayPacket packet;
+          uint32_t size;
+          int64_t delay;
+          uint32_t numParallelCon;
+          file >> size >> delay >> numParallelCon;
+          packet.SetSize (size);
+          packet.SetDelay (NanoSeconds (delay));
+          for (uint32_t j = 0; j < numParallelCon && file; j++)
+            {
+              uint16_t portClient;
+              uint16_t portServer;
+              uint32_t byteCount;
+              file >> portClient >> portServer >> byteCount;
+              packet.AddParallelConnection (portClient, portServer, byteCount);
+            }
+          packets.push_back (packet);
+        }
+    };
+  std::function<void (std::vector<uint32_t>&)> readCounts = [&file] (std::vector<uint32_t>& counts)
+    {
+      uint32_t size = 0;
+      file >> size;
+      for (uint32_t i = 0; i < size && file; i++)
         {
-          file << (it->second).numRep[i] << std::endl;
+          uint32_t count;
+          file >> count;
+          counts.push_back (count);
         }
+    };
+
+  std::string magic;
+  uint32_t version = 0;
+  file >> magic >> version;
+  if (magic != "TraceReplayAppendState" || version != APPEND_STATE_VERSION)
+    {
+      std::cerr << "State file " << path << " is not supported.\n";
+      exit (1);
+    }
+  bool originValid;
+  uint64_t originSec;
+  uint32_t originNsec;
+  uint64_t countPos;
+  m_clientTrace& trace = m_clients[0];
+  bool binary;
+  file >> originValid >> originSec >> originNsec >> m_nextIdleCheck >> countPos >> trace.numPrinted >> trace.numPackets
+       >> closedEnd >> binary;
+  trace.countPos = countPos;
+  if (file && binary != m_binaryTrace)
+    {
+      std::cerr << "Trace file of state file " << path << " is in the other format (see SetBinaryTrace).\n";
+      exit (1);
+    }
+  // Open connections were tracked with these settings, the next segment must use the same
+  int64_t idleTimeout;
+  uint32_t maxSegmentSize;
+  std::string filter;
+  file >> idleTimeout >> maxSegmentSize >> filter;
+  if (file && (idleTimeout != m_idleTimeout.GetNanoSeconds () || maxSegmentSize != m_maxSegmentSize
+               || filter != GetFilterSettings ()))
+    {
+      std::cerr << "State file " << path << " was written with another idle timeout, maximum segment size or filter.\n";
+      exit (1);
+    }
+  if (originValid)
+    {
+      reader.SetTimeOrigin (originSec, originNsec);
+    }
 
-      size = (it->second).expByteClient.size ();
-      file << size << std::endl;
-      for (uint32_t i = 0; i < size; i++)
+  // Free slots are kept, so new connections get the same indices as in a single conversion
+  uint32_t numSlots = 0;
+  uint32_t numFree = 0;
+  file >> numSlots >> numFree;
+  m_connInfo freeSlot;
+  freeSlot.open = false;
+  m_conns.assign (file ? numSlots : 0, freeSlot);
+  for (uint32_t i = 0; i < numFree && file; i++)
+    {
+      uint32_t index = numSlots;
+      file >> index;
+      if (index >= numSlots)
         {
-          file << (it->second).expByteClient[i] << std::endl;
+          file.setstate (std::ios::failbit);
         }
+      m_freeConns.push_back (index);
     }
-  file.close ();
+
+  uint32_t numOpen = 0;
+  file >> numOpen;
+  for (uint32_t i = 0; i < numOpen && file; i++)
+    {
+      uint32_t index = numSlots;
+      file >> index;
+      if (index >= numSlots)
+        {
+          file.setstate (std::ios::failbit);
+          break;
+        }
+      m_connInfo& conn = m_conns[index];
+      int64_t startTime;
+      int64_t currTime;
+      readId (conn.id);
+      file >> startTime >> currTime >> conn.packetCount >> conn.byteCount >> conn.totByteCount
+           >> conn.packetC2S >> conn.lastTime >> conn.finClient >> conn.finServer >> conn.filtered;
+      conn.startTime = NanoSeconds (startTime);
+      conn.currTime = NanoSeconds (currTime);
+      readState (conn.clientState);
+      readState (conn.serverState);
+      readPackets (conn.clientPackets);
+      readPackets (conn.serverPackets);
+      readCounts (conn.numReq);
+      readCounts (conn.expByteClient);
+      readCounts (conn.numRep);
+      readCounts (conn.expByteServer);
+      conn.open = true;
+      conn.client = 0;
+      conn.group = 0;
+      if (conn.filtered)
+        {
+          continue;
+        }
+
+      m_connId groupId = conn.id;
+      groupId.portClient = 0;
+      groupId.portServer = 0;
+      std::map<m_connId, uint32_t>::iterator it = m_connGroupMap.find (groupId);
+      if (it == m_connGroupMap.end ())
+        {
+          it = m_connGroupMap.insert (std::make_pair (groupId, m_connGroups.size ())).first;
+          m_connGroups.push_back (m_connGroup ());
+        }
+      conn.group = it->second;
+      m_connGroup& group = m_connGroups[conn.group];
+      group.open.insert (std::upper_bound (group.open.begin (), group.open.end (), index, [this] (uint32_t a, uint32_t b)
+        {
+          return m_conns[a].id < m_conns[b].id;
+        }), index);
+    }
+  if (!file)
+    {
+      std::cerr << "Error reading state file " << path << ".\n";
+      exit (1);
+    }
+
+  // Same load factor as kept by FindConnection
+  uint64_t tableSize = 1024;
+  while (tableSize <= m_conns.size () * 2)
+    {
+      tableSize *= 2;
+    }
+  m_connTable.assign (tableSize, 0);
+  for (uint32_t i = 0; i < m_conns.size (); i++)
+    {
+      if (m_conns[i].open)
+        {
+          uint64_t slot = m_conns[i].id.Hash () & (tableSize - 1);
+          while (m_connTable[slot] != 0)
+            {
+              slot = (slot + 1) & (tableSize - 1);
+            }
+          m_connTable[slot] = i + 1;
+        }
+    }
+  NS_LOG_INFO ("Restored " << numOpen << " open connections from " << path);
+  return true;
 }
 
 void
-TraceReplayHelper::DeleteTmpFiles ()
+TraceReplayHelper::SaveAppendState (std::string path, const TraceReplayPcapReader& reader, uint64_t closedEnd)
 {
-  // Remove all the temporary files
-  std::remove ("httpRequestFile");
-  std::remove ("tcpPackets.csv");
-  std::remove ("tcpTimeout");
+  NS_LOG_FUNCTION (this << path);
+  std::ofstream file (path.c_str ());
+  if (!file.is_open ())
+    {
+      std::cerr << "Error writing state file " << path << ".\n";
+      exit (1);
+    }
+  file << std::setprecision (17);
+
+  std::function<void (const m_connId&)> writeId = [&file] (const m_connId& id)
+    {
+      file << id.ipv6 << " " << std::hex << std::setfill ('0');
+      for (uint32_t i = 0; i < 16; i++)
+        {
+          file << std::setw (2) << (uint32_t) id.ipClient[i];
+        }
+      file << std::dec << " " << id.portClient << " " << std::hex;
+      for (uint32_t i = 0; i < 16; i++)
+        {
+          file << std::setw (2) << (uint32_t) id.ipServer[i];
+        }
+      file << std::dec << std::setfill (' ') << " " << id.portServer;
+    };
+  std::function<void (const m_tcpState&)> writeState = [&file] (const m_tcpState& state)
+    {
+      // Fields of a direction without any segment or ack yet are not set
+      file << state.seqValid << " " << (state.seqValid ? state.nextSeq : 0) << " "
+           << (state.seqValid ? state.nextSeqTime : 0) << " " << state.ackValid << " "
+           << (state.ackValid ? state.lastAck : 0) << " " << state.dupAckCount << " "
+           << (state.ackValid ? state.lastAckTime : 0) << "\n";
+    };
+  std::function<void (const std::vector<TraceReplayPacket>&)> writePackets = [&file] (const std::vector<TraceReplayPacket>& packets)
+    {
+      file << packets.size () << "\n";
+      for (uint32_t i = 0; i < packets.size (); i++)
+        {
+          TraceReplayPacket packet = packets[i];
+          uint32_t numParallelCon = packet.GetDelay ().IsStrictlyPositive () ? packet.GetNumParallelConnection () : 0;
+          file << packet.GetSize () << " " << packet.GetDelay ().GetNanoSeconds () << " " << numParallelCon;
+          for (uint32_t j = 0; j < numParallelCon; j++)
+            {
+              std::pair<uint16_t, uint16_t> connId = packet.GetConnectionId (j);
+              file << " " << connId.first << " " << connId.second << " " << packet.GetByteCount (j);
+            }
+          file << "\n";
+        }
+    };
+  std::function<void (const std::vector<uint32_t>&)> writeCounts = [&file] (const std::vector<uint32_t>& counts)
+    {
+      file << counts.size ();
+      for (uint32_t i = 0; i < counts.size (); i++)
+        {
+          file << " " << counts[i];
+        }
+      file << "\n";
+    };
+
+  uint64_t originSec = 0;
+  uint32_t originNsec = 0;
+  bool originValid = reader.GetTimeOrigin (originSec, originNsec);
+  const m_clientTrace& trace = m_clients[0];
+  file << "TraceReplayAppendState " << APPEND_STATE_VERSION << "\n";
+  file << originValid << " " << originSec << " " << originNsec << " " << m_nextIdleCheck << "\n";
+  file << (uint64_t) trace.countPos << " " << trace.numPrinted << " " << trace.numPackets << " " << closedEnd
+       << " " << m_binaryTrace << "\n";
+  file << m_idleTimeout.GetNanoSeconds () << " " << m_maxSegmentSize << " " << GetFilterSettings () << "\n";
+
+  file << m_conns.size () << " " << m_freeConns.size ();
+  for (uint32_t i = 0; i < m_freeConns.size (); i++)
+    {
+      file << " " << m_freeConns[i];
+    }
+  file << "\n";
+
+  file << m_conns.size () - m_freeConns.size () << "\n";
+  for (uint32_t i = 0; i < m_conns.size (); i++)
+    {
+      const m_connInfo& conn = m_conns[i];
+      if (!conn.open)
+        {
+          continue;
+        }
+      file << i << " ";
+      writeId (conn.id);
+      file << " " << conn.startTime.GetNanoSeconds () << " " << conn.currTime.GetNanoSeconds ()
+           << " " << conn.packetCount << " " << conn.byteCount << " " << conn.totByteCount
+           << " " << conn.packetC2S << " " << conn.lastTime << " " << conn.finClient << " " << conn.finServer
+           << " " << conn.filtered << "\n";
+      writeState (conn.clientState);
+      writeState (conn.serverState);
+      writePackets (conn.clientPackets);
+      writePackets (conn.serverPackets);
+      writeCounts (conn.numReq);
+      writeCounts (conn.expByteClient);
+      writeCounts (conn.numRep);
+      writeCounts (conn.expByteServer);
+    }
+  file.close ();
+  if (file.fail ())
+    {
+      std::cerr << "Error writing state file " << path << ".\n";
+      exit (1);
+    }
 }
 
-void
-TraceReplayHelper::ConvertPcapToTrace ()
+// Version of the trace file written by the conversion. Must be changed
+// whenever the conversion gives a different trace file for the same pcap,
+// so that older cache entries are not used.
+static const char* const CONVERSION_VERSION = "3";
+
+/**
+ * \brief Hashes the contents of a file, 8 bytes at a time
+ *
+ * \param path Path of the file
+ * \param hash Set to the hash of the file
+ *
+ * \returns False if the file can not be read
+ */
+static bool
+HashFile (std::string path, uint64_t& hash)
 {
-  RunCommands ();
-  ProcessHttpList ();
-  ProcessTimeoutList ();
-  ProcessPacketList ();
-  PrintTraceFile ();
-  DeleteTmpFiles ();
+  int fd = open (path.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+  // One extra word holds the bytes of a partial word carried over from the previous read
+  std::vector<uint64_t> buffer ((1 << 17) + 1);
+  char* bytes = reinterpret_cast<char*> (&buffer[0]);
+  hash = 0x9e3779b97f4a7c15ULL;
+  uint64_t length = 0;
+  uint32_t carry = 0;
+  ssize_t count;
+  while ((count = read (fd, bytes + carry, (buffer.size () - 1) * sizeof (uint64_t))) > 0)
+    {
+      // Only whole words are mixed, whatever the size of the read
+      uint64_t available = carry + count;
+      for (uint64_t i = 0; i < available / 8; i++)
+        {
+          hash ^= buffer[i] * 0xc2b2ae3d27d4eb4fULL;
+          hash = ((hash << 31) | (hash >> 33)) * 0x9e3779b97f4a7c15ULL;
+        }
+      carry = available % 8;
+      std::memmove (bytes, bytes + available - carry, carry);
+      length += count;
+    }
+  close (fd);
+  if (count < 0)
+    {
+      return false;
+    }
+  if (carry > 0)
+    {
+      // Last partial word is zero padded, the length is mixed in below
+      std::memset (bytes + carry, 0, 8 - carry);
+      hash ^= buffer[0] * 0xc2b2ae3d27d4eb4fULL;
+      hash = ((hash << 31) | (hash >> 33)) * 0x9e3779b97f4a7c15ULL;
+    }
+  hash ^= length;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return true;
 }
 
 std::string
-TraceReplayHelper::CheckRegex (std::ifstream& infile, std::regex reg)
+TraceReplayHelper::GetCacheEntry ()
 {
-  std::string line;
-  while (getline (infile, line))
+  NS_LOG_FUNCTION (this);
+  if (m_cacheDir.empty ())
+    {
+      return "";
+    }
+  struct stat st;
+  if (stat (m_pcapPath.c_str (), &st) != 0 || !S_ISREG (st.st_mode))
     {
-      if (std::regex_search (line.begin (), line.end (), std::regex ("^#")))
+      // A pipe can be read only once, by the conversion
+      return "";
+    }
+
+  // Hash of each pcap seen by this process, valid while the file is not modified
+  static std::mutex hashMutex;
+  static std::map<std::string, std::pair<std::string, uint64_t> > hashes;
+  std::ostringstream fileId;
+  fileId << st.st_dev << ":" << st.st_ino << ":" << st.st_size << ":"
+         << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+  uint64_t hash;
+  {
+    std::lock_guard<std::mutex> lock (hashMutex);
+    std::map<std::string, std::pair<std::string, uint64_t> >::iterator it = hashes.find (m_pcapPath);
+    if (it != hashes.end () && it->second.first == fileId.str ())
+      {
+        hash = it->second.second;
+      }
+    else
+      {
+        if (!HashFile (m_pcapPath, hash))
+          {
+            return "";
+          }
+        hashes[m_pcapPath] = std::make_pair (fileId.str (), hash);
+      }
+  }
+
+  // Conversion parameters which change the trace file are part of the name
+  std::ostringstream entry;
+  entry << m_cacheDir << "/" << std::hex << std::setw (16) << std::setfill ('0') << hash << std::dec
+        << "-" << st.st_size << "-v" << CONVERSION_VERSION;
+  if (m_streaming)
+    {
+      entry << "-stream" << m_idleTimeout.GetNanoSeconds ();
+    }
+  if (m_maxSegmentSize > 0)
+    {
+      entry << "-mss" << m_maxSegmentSize;
+    }
+  if (!m_filter.IsEmpty ())
+    {
+      // FNV-1a hash of the filter settings
+      uint64_t filterHash = 14695981039346656037ULL;
+      std::string text = GetFilterSettings ();
+      for (uint32_t i = 0; i < text.size (); i++)
         {
-          continue;
+          filterHash = (filterHash ^ (uint8_t) text[i]) * 1099511628211ULL;
         }
-      else
+      entry << "-filter" << std::hex << std::setw (16) << std::setfill ('0') << filterHash << std::dec;
+    }
+  entry << GetTraceExtension ();
+  return entry.str ();
+}
+
+std::string
+TraceReplayHelper::GetFilterSettings () const
+{
+  std::ostringstream filter;
+  filter << std::setprecision (17) << m_filter.subnet << m_filter.ipv6 << ":" << m_filter.start << ":" << m_filter.end << ":";
+  for (uint32_t i = 0; i < 16; i++)
+    {
+      filter << (uint32_t) m_filter.network[i] << "/" << (uint32_t) m_filter.mask[i] << ",";
+    }
+  for (uint32_t port = 0; port < m_filter.serverPorts.size (); port++)
+    {
+      if (m_filter.serverPorts[port])
         {
-          break;
+          filter << port << ",";
+        }
+    }
+  return filter.str ();
+}
+
+void
+TraceReplayHelper::StoreCacheEntry (std::string entry)
+{
+  NS_LOG_FUNCTION (this << entry);
+  if (entry.empty ())
+    {
+      return;
+    }
+  // A missing cache directory is created, failures only disable caching
+  mkdir (m_cacheDir.c_str (), 0777);
+  std::string traceFile = m_scratchDir + "/" + m_clients[0].name;
+  // Temporary name is unique as the scratch directory name is unique
+  std::string tmpEntry = entry + "." + m_scratchDir.substr (m_scratchDir.rfind ('/') + 1);
+  if (link (traceFile.c_str (), tmpEntry.c_str ()) != 0)
+    {
+      // Cache is on another file system, copy the trace file
+      std::ifstream in (traceFile.c_str ());
+      std::ofstream out (tmpEntry.c_str ());
+      out << in.rdbuf ();
+      out.close ();
+      if (!in || out.fail ())
+        {
+          NS_LOG_WARN ("Could not store trace file in cache " << m_cacheDir);
+          std::remove (tmpEntry.c_str ());
+          return;
         }
     }
-  if (std::regex_search (line.begin (), line.end (), reg))
+  if (std::rename (tmpEntry.c_str (), entry.c_str ()) != 0)
     {
-      return line;
+      NS_LOG_WARN ("Could not store trace file in cache " << m_cacheDir);
+      std::remove (tmpEntry.c_str ());
     }
-  else
+}
+
+void
+TraceReplayHelper::ReadTraceLine (std::istream& infile, TraceReplayFieldParser& parser)
+{
+  if (!parser.ReadLine (infile))
     {
-      std::cerr << "Input trace file is corrupted!";
-      exit (1);
+      parser.Fail ("unexpected end of trace file");
     }
 }
 
+uint32_t
+TraceReplayHelper::ReadTraceCount (std::istream& infile, TraceReplayFieldParser& parser)
+{
+  ReadTraceLine (infile, parser);
+  uint32_t count = parser.ReadUint32 ();
+  parser.ExpectEnd ();
+  return count;
+}
+
 void
 TraceReplayHelper::Install (Ptr<Node> clientNode, Ptr<Node> remoteNode, Address remoteAddress)
 {
   NS_LOG_FUNCTION (this);
 
   std::string filename = "";
+  bool converted = false;
+  std::string cacheEntry = "";
   if (std::ifstream (m_pcapPath.c_str ()))
     {
-      // Valid pcap file. Overwrite trace file (if present)
-      ConvertPcapToTrace ();
-      filename = "traceFile.txt";
+      cacheEntry = GetCacheEntry ();
+      if (!cacheEntry.empty () && std::ifstream (cacheEntry.c_str ()))
+        {
+          // Same pcap was converted before with the same parameters
+          NS_LOG_INFO ("Using cached trace file " << cacheEntry);
+          filename = cacheEntry;
+        }
+      else
+        {
+          // Valid pcap file. Overwrite trace file (if present)
+          ConvertPcapToTrace ();
+          filename = m_scratchDir + "/" + m_clients[0].name;
+          converted = true;
+        }
     }
   else if (std::ifstream (m_traceFilePath.c_str ()))
     {
@@ -614,253 +2359,221 @@ TraceReplayHelper::Install (Ptr<Node> clientNode, Ptr<Node> remoteNode, Address
       exit (1);
     }
 
-  std::ifstream infile (filename.c_str ());
-  if (!infile.is_open ())
+  // Every node replaying the same trace file shares one trace, which is loaded only once
+  Ptr<const TraceReplayTrace> trace;
+  if (!converted)
     {
-      std::cerr << "Error opening trace file.\n";
-      exit (1);
+      trace = TraceReplayTrace::Find (filename);
     }
-
-  uint32_t numConn = 0; // number of connection per client
-  std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-  std::istringstream iss (line);
-  iss >> numConn;
-
-  // for each connection read the data and initialize client-server connection pair
-  for (uint32_t j = 0; j < numConn; j++)
+  bool loaded = trace == 0;
+  if (loaded)
     {
-      // real ip and port numbers
-      std::string ipClientTmp = "";
-      uint16_t portClient = 0;
-      std::string ipServerTmp = "";
-      uint16_t portServer = 0;
-      double startTime = 0.0;
-      {
-        std::string line = CheckRegex (infile, std::regex ("^*\t[0-9]+\t*[0-9]+\t[0-9]+[.]?[0-9]*$"));
-        std::istringstream iss (line);
-        iss >> ipClientTmp >> portClient >> ipServerTmp >> portServer >> startTime;
-      }
-
-      Address ipClient;
-      if (std::regex_search (ipClientTmp.begin (), ipClientTmp.end (), std::regex ("^[0-9]+[.][0-9]+[.][0-9]+[.][0-9]+$")))
-        {
-          ipClient = Ipv4Address (ipClientTmp.c_str ());
-        }
-      else
+      // Binary trace files are mapped, before a converted trace file is renamed
+      bool binary = TraceReplayTrace::IsBinaryTrace (filename);
+      if (binary)
         {
-          ipClient = Ipv6Address (ipClientTmp.c_str ());
+          trace = Create<TraceReplayTrace> (filename);
         }
-
-      Address ipServer;
-      if (std::regex_search (ipServerTmp.begin (), ipServerTmp.end (), std::regex ("^[0-9]+[.][0-9]+[.][0-9]+[.][0-9]+$")))
+      std::ifstream infile (filename.c_str ());
+      if (!infile.is_open ())
         {
-          ipServer = Ipv4Address (ipServerTmp.c_str ());
+          std::cerr << "Error opening trace file.\n";
+          exit (1);
         }
-      else
+      if (converted)
         {
-          ipServer = Ipv6Address (ipServerTmp.c_str ());
+          // Trace file stays readable through infile after it is renamed
+          StoreCacheEntry (cacheEntry);
+          DeleteTmpFiles ();
         }
 
-      // Each connections will get port number sequentially starting from m_portNumber.
-      uint16_t portNumber = m_portNumber + j;
-      Address address;
-      if (Ipv4Address::IsMatchingType (remoteAddress) == true)
+      if (!binary)
         {
-          address = InetSocketAddress (Ipv4Address::ConvertFrom (remoteAddress), portNumber);
+          trace = LoadTextTrace (infile, filename);
         }
-      else
-        {
-          address = Inet6SocketAddress (Ipv6Address::ConvertFrom (remoteAddress), portNumber);
-        }
-      // Client to server connection
-      {
-        uint16_t numPacket = 0;
-        {
-          std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-          std::istringstream iss (line);
-          iss >> numPacket;
-        }
-        {
-          std::vector<TraceReplayPacket> packetList;
-          for (uint16_t k = 0; k < numPacket; k++)
-            {
-              TraceReplayPacket packet;
-              uint32_t packetSize = 0;
-              double delay = 0.0;
-              {
-                std::string line = CheckRegex (infile, std::regex ("^[0-9]+\t[0-9]+[.]?[0-9]*$"));
-                std::istringstream iss (line);
-                iss >> packetSize >> delay;
-              }
-              if (delay > 0)
-                {
-                  uint32_t n = 0; // number of parallel connection
-                  {
-                    std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-                    std::istringstream iss (line);
-                    iss >> n;
-                  }
-                  for (uint32_t i = 0; i < n; i++)
-                    {
-                      uint16_t srcPort = 0;
-                      uint16_t dstPort = 0;
-                      uint32_t count = 0;
-                      {
-                        std::string line = CheckRegex (infile, std::regex ("^[0-9]+\t[0-9]+\t[0-9]+$"));
-                        std::istringstream iss (line);
-                        iss >> srcPort >> dstPort >> count;
-                      }
-                      packet.AddParallelConnection (srcPort, dstPort, count);
-                    }
-                }
+      infile.close ();
+      // Trace is shared under the name later Install calls find it by
+      TraceReplayTrace::Share (converted ? cacheEntry : filename, trace);
+    }
 
-              packet.SetSize (packetSize);
-              packet.SetDelay (Seconds (delay));
-              packetList.push_back (packet);
-            }
+  // for each connection initialize client-server connection pair
+  for (uint32_t j = 0; j < trace->GetNConnections (); j++)
+    {
+      InstallConnection (trace, j, clientNode, remoteNode, remoteAddress);
+    }
+  // Pages read while loading and installing are given back, each connection
+  // reads its packets again when it starts. A trace which was already shared
+  // may be replayed by running applications, its pages are left to them.
+  if (loaded)
+    {
+      trace->Release ();
+    }
+}
 
-          uint32_t nRequest = 0; // number of requests
-          {
-            std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-            std::istringstream iss (line);
-            iss >> nRequest;
-          }
-          std::vector<uint32_t> numReq;
-          for (uint32_t k = 0; k < nRequest; k++)
+void
+TraceReplayHelper::ReadTracePackets (std::istream& infile, TraceReplayFieldParser& parser, std::vector<TraceReplayPacket>& packets)
+{
+  uint32_t numPacket = ReadTraceCount (infile, parser);
+  packets.clear ();
+  for (uint32_t k = 0; k < numPacket; k++)
+    {
+      TraceReplayPacket packet;
+      ReadTraceLine (infile, parser);
+      uint32_t packetSize = parser.ReadUint32 ();
+      double delay = parser.ReadDouble ();
+      parser.ExpectEnd ();
+      if (delay > 0)
+        {
+          uint32_t n = ReadTraceCount (infile, parser); // number of parallel connection
+          for (uint32_t i = 0; i < n; i++)
             {
-              uint32_t count = 0; // number of packets to send per request
-              {
-                std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-                std::istringstream iss (line);
-                iss >> count;
-              }
-              numReq.push_back (count);
+              ReadTraceLine (infile, parser);
+              uint16_t srcPort = parser.ReadUint16 ();
+              uint16_t dstPort = parser.ReadUint16 ();
+              uint32_t count = parser.ReadUint32 ();
+              parser.ExpectEnd ();
+              packet.AddParallelConnection (srcPort, dstPort, count);
             }
+        }
 
-          uint32_t nReply = 0; // number of Reply from server
-          {
-            std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-            std::istringstream iss (line);
-            iss >> nReply;
-          }
-          std::vector<uint32_t> expByte;
-          for (uint32_t k = 0; k < nReply; k++)
-            {
-              uint32_t count; // number of total bytes to receive, as reply, for each request
-              {
-                std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-                std::istringstream iss (line);
-                iss >> count;
-              }
-              expByte.push_back (count);
-            }
+      packet.SetSize (packetSize);
+      packet.SetDelay (Seconds (delay));
+      packets.push_back (packet);
+    }
+}
 
-          // Initialize TraceReplayClient
-          Ptr<TraceReplayClient> client = CreateObject<TraceReplayClient> ();
-          client->SetConnectionId (ipClient, portClient, ipServer, portServer);
-          client->Setup (address, m_dataRate, numReq, expByte, packetList);
-          // Start time of connection is :
-          // Actual start time taken from trace file +
-          // offset set by user +
-          // jitter to avoid synchronization (max 1 second)
-          client->SetStartTime (Seconds (startTime) + m_startTimeOffset + MilliSeconds (m_startTimeJitter->GetValue ()));
-          client->SetStopTime (Seconds (m_stopTime));
-          clientNode->AddApplication (client);
-        }
-      }
-      // Server to client connection
-      {
-        uint16_t numPacket = 0;
+void
+TraceReplayHelper::ReadTraceCounts (std::istream& infile, TraceReplayFieldParser& parser, std::vector<uint32_t>& counts)
+{
+  uint32_t size = ReadTraceCount (infile, parser);
+  counts.clear ();
+  for (uint32_t k = 0; k < size; k++)
+    {
+      counts.push_back (ReadTraceCount (infile, parser));
+    }
+}
+
+void
+TraceReplayHelper::ReadTraceConnection (std::istream& infile, TraceReplayFieldParser& parser, m_connInfo& conn)
+{
+  // real ip and port numbers
+  ReadTraceLine (infile, parser);
+  conn.id.ipv6 = parser.ReadAddress (conn.id.ipClient);
+  conn.id.portClient = parser.ReadUint16 ();
+  if (parser.ReadAddress (conn.id.ipServer) != conn.id.ipv6)
+    {
+      parser.Fail ("client and server ip addresses are of different types");
+    }
+  conn.id.portServer = parser.ReadUint16 ();
+  conn.startTime = Seconds (parser.ReadDouble ());
+  parser.ExpectEnd ();
+
+  // Client to server: packets, packets to send per request, bytes to receive as reply for each request
+  ReadTracePackets (infile, parser, conn.clientPackets);
+  ReadTraceCounts (infile, parser, conn.numReq);
+  ReadTraceCounts (infile, parser, conn.expByteServer);
+  // Server to client: packets, packets to send in each reply, bytes expected in each request
+  ReadTracePackets (infile, parser, conn.serverPackets);
+  ReadTraceCounts (infile, parser, conn.numRep);
+  ReadTraceCounts (infile, parser, conn.expByteClient);
+}
+
+Ptr<const TraceReplayTrace>
+TraceReplayHelper::LoadTextTrace (std::istream& infile, std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+  TraceReplayFieldParser parser (filename);
+  uint32_t numConn = ReadTraceCount (infile, parser); // number of connection per client
+  std::string buffer;
+  TraceReplayTrace::WriteHeader (buffer, numConn, 0);
+
+  // Converted connections go to a temporary file which is mapped like a binary
+  // trace file, so that only the pages of the connections being replayed stay
+  // in memory. It is unlinked at once, nothing is left behind on exit.
+  std::string pattern = m_outputDir + "/.trace-replay-XXXXXX";
+  std::vector<char> path (pattern.begin (), pattern.end ());
+  path.push_back ('\0');
+  int fd = mkstemp (&path[0]);
+  if (fd >= 0)
+    {
+      unlink (&path[0]);
+    }
+  else
+    {
+      NS_LOG_WARN ("Could not create temporary file in " << m_outputDir << ", trace is kept in memory");
+    }
+
+  m_connInfo conn;
+  for (uint32_t j = 0; j <= numConn; j++)
+    {
+      if (j < numConn)
         {
-          std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-          std::istringstream iss (line);
-          iss >> numPacket;
+          ReadTraceConnection (infile, parser, conn);
+          WriteBinaryConnection (buffer, conn);
         }
+      // Buffer is written out in large blocks, and once all connections are read
+      if (fd >= 0 && (buffer.size () >= (1 << 20) || j == numConn))
         {
-          std::vector<TraceReplayPacket> packetList;
-          for (uint16_t k = 0; k < numPacket; k++)
+          for (std::string::size_type done = 0; done < buffer.size (); )
             {
-              TraceReplayPacket packet;
-              uint32_t packetSize = 0;
-              double delay = 0.0;
-              {
-                std::string line = CheckRegex (infile, std::regex ("^[0-9]+\t[0-9]+[.]?[0-9]*$"));
-                std::istringstream iss (line);
-                iss >> packetSize >> delay;
-              }
-              if (delay > 0)
+              ssize_t written = write (fd, buffer.data () + done, buffer.size () - done);
+              if (written <= 0)
                 {
-                  uint32_t n = 0; // number of parallel connection
-                  {
-                    std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-                    std::istringstream iss (line);
-                    iss >> n;
-                  }
-                  for (uint32_t i = 0; i < n; i++)
-                    {
-                      uint16_t srcPort = 0;
-                      uint16_t dstPort = 0;
-                      uint32_t count = 0;
-                      {
-                        std::string line = CheckRegex (infile, std::regex ("^[0-9]+\t[0-9]+\t[0-9]+$"));
-                        std::istringstream iss (line);
-                        iss >> srcPort >> dstPort >> count;
-                      }
-                      packet.AddParallelConnection (srcPort, dstPort, count);
-                    }
+                  std::cerr << "Error writing temporary trace file in " << m_outputDir << ".\n";
+                  exit (1);
                 }
-
-              packet.SetSize (packetSize);
-              packet.SetDelay (Seconds (delay));
-              packetList.push_back (packet);
-            }
-
-          uint32_t nReply = 0; // number of reply
-          {
-            std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-            std::istringstream iss (line);
-            iss >> nReply;
-          }
-          std::vector<uint32_t> numRep;
-          for (uint32_t k = 0; k < nReply; k++)
-            {
-              uint32_t count; // number of packets to send in each reply
-              {
-                std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-                std::istringstream iss (line);
-                iss >> count;
-              }
-              numRep.push_back (count);
+              done += written;
             }
+          buffer.clear ();
+        }
+    }
+  if (fd < 0)
+    {
+      return Create<TraceReplayTrace> (filename, buffer);
+    }
+  Ptr<const TraceReplayTrace> trace = Create<TraceReplayTrace> (filename, fd);
+  close (fd);
+  return trace;
+}
 
-          uint32_t nRequest = 0; // number of request
-          std::vector<uint32_t> expByte;
-          {
-            std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-            std::istringstream iss (line);
-            iss >> nRequest;
-          }
-          for (uint32_t k = 0; k < nRequest; k++)
-            {
-              uint32_t count = 0; // total bytes expected in each request
-              {
-                std::string line = CheckRegex (infile, std::regex ("^[0-9]+$"));
-                std::istringstream iss (line);
-                iss >> count;
-              }
-              expByte.push_back (count);
-            }
+void
+TraceReplayHelper::InstallConnection (Ptr<const TraceReplayTrace> trace, uint32_t index, Ptr<Node> clientNode, Ptr<Node> remoteNode, Address remoteAddress)
+{
+  Address ipClient = trace->GetIpClient (index);
+  Address ipServer = trace->GetIpServer (index);
+  uint16_t portClient = trace->GetPortClient (index);
+  uint16_t portServer = trace->GetPortServer (index);
 
-          // Initiliaze TraceReplayServer
-          Ptr<TraceReplayServer> server = CreateObject<TraceReplayServer> ();
-          server->SetConnectionId (ipClient, portClient, ipServer, portServer);
-          server->Setup (address, m_dataRate, numRep, expByte, packetList);
-          server->SetStartTime (Seconds (0.0));
-          server->SetStopTime (Seconds (m_stopTime));
-          remoteNode->AddApplication (server);
-        }
-      }
+  // Each connections will get port number sequentially starting from m_portNumber.
+  uint16_t portNumber = m_portNumber + index;
+  Address address;
+  if (Ipv4Address::IsMatchingType (remoteAddress) == true)
+    {
+      address = InetSocketAddress (Ipv4Address::ConvertFrom (remoteAddress), portNumber);
+    }
+  else
+    {
+      address = Inet6SocketAddress (Ipv6Address::ConvertFrom (remoteAddress), portNumber);
     }
-  infile.close ();
+
+  // Initialize TraceReplayClient
+  Ptr<TraceReplayClient> client = CreateObject<TraceReplayClient> ();
+  client->SetConnectionId (ipClient, portClient, ipServer, portServer);
+  client->Setup (address, m_dataRate, trace, index);
+  // Start time of connection is :
+  // Actual start time taken from trace file +
+  // offset set by user +
+  // jitter to avoid synchronization (max 1 second)
+  client->SetStartTime (trace->GetStartTime (index) + m_startTimeOffset + MilliSeconds (m_startTimeJitter->GetValue ()));
+  client->SetStopTime (Seconds (m_stopTime));
+  clientNode->AddApplication (client);
+
+  // Initiliaze TraceReplayServer
+  Ptr<TraceReplayServer> server = CreateObject<TraceReplayServer> ();
+  server->SetConnectionId (ipClient, portClient, ipServer, portServer);
+  server->Setup (address, m_dataRate, trace, index);
+  server->SetStartTime (Seconds (0.0));
+  server->SetStopTime (Seconds (m_stopTime));
+  remoteNode->AddApplication (server);
 }
 } // namespace ns3
@@ -28,15 +28,43 @@
 #include <sstream>
 #include <vector>
 #include <cstdlib>
+#include <cstdio>
 #include <ctime>
 #include <map>
-#include <regex>
+#include <list>
+#include <chrono>
+#include "trace-replay-pcap-reader.h"
 
 namespace ns3 {
 
 class TraceReplayPacket;
+class TraceReplayTrace;
+class TraceReplayFieldParser;
 class Address;
 
+/**
+ * \brief Time and memory taken by the stages of the last conversion of a TraceReplayHelper
+ *
+ * Peak RSS of a stage is the peak resident set size of the process during
+ * that stage only, as the peak is reset at the start of each stage on Linux.
+ * Elsewhere it is the peak of the process since it started.
+ */
+struct TraceReplayConversionStats
+{
+  uint64_t        pcapSize;         //!< Size of the pcap file (bytes)
+  uint64_t        numSegments;      //!< Number of tcp segments mapped to connections
+  uint64_t        numConnections;   //!< Number of connections written to the trace files
+  double          trackTime;        //!< Time to decode the pcap and map its segments to connections (seconds)
+  uint64_t        trackRss;         //!< Peak RSS during flow tracking (KB)
+  double          parallelTime;     //!< Time to list the parallel connections of packets, part of trackTime (seconds)
+  uint64_t        numParallelLists; //!< Number of packets whose parallel connections were listed
+  uint64_t        numParallelEntries; //!< Number of parallel connections listed
+  double          stateTime;        //!< Time to save the open connections, only done by AppendPcap (seconds)
+  uint64_t        stateRss;         //!< Peak RSS while saving the open connections (KB)
+  double          writeTime;        //!< Time to write the trace files (seconds)
+  uint64_t        writeRss;         //!< Peak RSS during writing (KB)
+};
+
 /**
  * \brief TraceReplayHelper make it easier to analyse input pcap file
  * and initialize connections between TraceReplayClient and TraceReplayServer
@@ -112,10 +140,200 @@ public:
    */
   void SetPortNumber (uint16_t port);
 
+  /**
+   * \brief This method sets the number of threads used to decode the input pcap.
+   *
+   * The pcap is split into record-aligned chunks which are decoded in parallel.
+   * Packets are still mapped to connections in frame order, so the trace file
+   * does not depend on the number of threads.
+   *
+   * \param numThreads Number of decoding threads (0 means one per hardware thread)
+   */
+  void SetNumThreads (uint32_t numThreads);
+
+  /**
+   * \brief This method selects the binary format for the trace files written by conversions.
+   *
+   * The binary format is little endian: a header with magic, version and
+   * counts, then for each connection a record with its addresses, start time
+   * and the offsets of its packets, parallel connections and counts (see
+   * TraceReplayTrace). Install maps it instead of parsing it, so it loads
+   * much faster than the text format. Trace files are then
+   * named traceFile.bin (traceFile-<client ip>.bin). Install reads both
+   * formats, the format of a trace file is found from its first bytes.
+   *
+   * \param binary True to write binary trace files (default false)
+   */
+  void SetBinaryTrace (bool binary);
+
+  /**
+   * \brief This method enables streaming conversion of the input pcap.
+   *
+   * In streaming mode, a connection is written to the trace file and its
+   * packet lists are freed as soon as it is closed (FIN from both sides or RST)
+   * or has been idle for the idle timeout (see SetIdleTimeout). Memory used by
+   * the conversion is then proportional to the number of connections open at
+   * the same time, instead of the size of the pcap. Connections are written in
+   * the order they are closed, and packets without payload which do not belong
+   * to an open connection (like the last ack after FIN) are ignored.
+   *
+   * \param streaming True to enable streaming conversion
+   */
+  void SetStreaming (bool streaming);
+
+  /**
+   * \brief This method sets the idle time after which a connection is closed in streaming mode.
+   *
+   * A packet arriving later on the same ip and port numbers starts a new connection.
+   *
+   * \param idleTimeout Idle timeout (default 60 seconds)
+   */
+  void SetIdleTimeout (Time idleTimeout);
+
+  /**
+   * \brief This method restricts the conversion to the connections of clients in an IPv4 subnet.
+   *
+   * The client of a connection is the host which sent the SYN, or the sender of its
+   * first packet if the SYN was not captured. Connections to a server in the subnet
+   * are dropped unless their client is in it too.
+   *
+   * \param network Network address of the clients
+   * \param mask Network mask of the clients
+   */
+  void SetClientSubnet (Ipv4Address network, Ipv4Mask mask);
+
+  /**
+   * \brief This method restricts the conversion to the connections of clients in an IPv6 subnet.
+   *
+   * The client is found as for an IPv4 subnet.
+   *
+   * \param network Network address of the clients
+   * \param prefix Network prefix of the clients
+   */
+  void SetClientSubnet (Ipv6Address network, Ipv6Prefix prefix);
+
+  /**
+   * \brief This method adds a server port to convert. If no port is added, all the ports are converted.
+   *
+   * \param port Server port number (like 80 or 443)
+   */
+  void AddServerPort (uint16_t port);
+
+  /**
+   * \brief This method restricts the conversion to the packets captured in a time window.
+   *
+   * Times are relative to the first frame of the pcap, as frame.time_relative of tshark.
+   * Start times of the connections in the trace file are then relative to the start of
+   * the window, so that the warmup period before it is not replayed.
+   *
+   * \param start Start of the window
+   * \param end End of the window
+   */
+  void SetTimeWindow (Time start, Time end);
+
+  /**
+   * \brief This method enables the time index of the input pcap.
+   *
+   * The first conversion of a pcap writes a sparse index of its frame times
+   * next to it (<pcap>.tridx). Later conversions of the same pcap with a time
+   * window (see SetTimeWindow) use the index to read only the part of the pcap
+   * in the window. The index is rebuilt when the pcap is modified. Compressed
+   * pcaps are not indexed.
+   *
+   * \param timeIndex True to build and use the time index
+   */
+  void SetTimeIndex (bool timeIndex);
+
+  /**
+   * \brief This method sets the segment size to which large payloads are split.
+   *
+   * Captures taken with TSO/GRO offload contain tcp segments of up to 64 KB.
+   * Each payload larger than mss is stored as several packets of at most mss
+   * bytes with the same time, so that the applications write it to the socket
+   * in mss sized pieces instead of waiting for the whole of it to fit in the
+   * tx buffer. Only the first of the packets carries the delay of the segment.
+   *
+   * \param mss Maximum segment size in bytes (default 0, payloads are not split)
+   */
+  void SetMaxSegmentSize (uint32_t mss);
+
+  /**
+   * \brief This method sets the directory used to cache the trace files converted from pcaps.
+   *
+   * A converted trace file is stored under a hash of the pcap contents and of
+   * the conversion parameters (streaming mode and idle timeout). A later Install
+   * with the same pcap and parameters, in this or another simulation, loads the
+   * cached trace file instead of converting the pcap again. A cache hit does
+   * not rewrite traceFile.txt. Entries are published atomically, so simulations
+   * running at the same time can share the directory.
+   *
+   * \param directory Cache directory (default "trace-replay-cache"), empty string disables the cache
+   */
+  void SetCacheDirectory (std::string directory);
+
+  /**
+   * \brief Converts the pcap set by SetPcap to a trace file, without installing any application.
+   *
+   * Same conversion as done by Install. The trace file is written in a scratch
+   * directory next to it and renamed when complete. The cache is not used.
+   *
+   * \param traceFile Path of the trace file to write
+   */
+  void ConvertPcap (std::string traceFile);
+
+  /**
+   * \brief Appends the pcap set by SetPcap, the next segment of a rolling capture, to a trace file.
+   *
+   * Connections are written to the trace file as in streaming mode (see
+   * SetStreaming). The connections still open at the end of the segment are
+   * written at the end of the trace file, so that it can be replayed, and are
+   * also kept in a state file next to it (<traceFile>.state). The next call
+   * continues them from the state file and replaces only that end of the trace
+   * file, so its cost depends on the new segment and not on the earlier ones
+   * (apart from copying the rest of the trace file to a new file, which is
+   * renamed over it so that a replay mapping the old one is not affected).
+   * Closed connections are not kept, so they are not listed as parallel
+   * connections of the packets of later segments.
+   * A new trace file is started if there is no state file. Segments must be
+   * appended in capture order; times are relative to the first frame of the
+   * first segment. A time window (see SetTimeWindow) can not be used. The
+   * idle timeout, maximum segment size and filters must be the same for all
+   * the segments.
+   *
+   * \param traceFile Path of the trace file to append to
+   */
+  void AppendPcap (std::string traceFile);
+
+  /**
+   * \brief Converts a pcap with several clients into one trace file per client, in a single pass.
+   *
+   * Client of a connection is the host which sent the SYN (the destination of
+   * the SYN-ACK if only that was captured, or else the sender of the first
+   * packet). Trace files are named traceFile-<client ip>.txt, with the ':' of
+   * ipv6 addresses replaced by '-', and are written to the directory at the
+   * same time by a pool of threads (see SetNumThreads). In streaming mode only
+   * a bounded number of them are open at a time. Each of them can be given to
+   * a client with SetTraceFile.
+   *
+   * \param directory Directory to write the trace files to
+   *
+   * \returns Paths of the trace files, in the order of client ip
+   */
+  std::vector<std::string> ConvertPcapPerClient (std::string directory);
+
+  /**
+   * \brief Gets the time and memory taken by the last conversion
+   *
+   * \returns Statistics of the last ConvertPcap, AppendPcap, ConvertPcapPerClient or Install which converted a pcap
+   */
+  TraceReplayConversionStats GetConversionStats (void) const;
+
   /**
    * \brief Creates the trace file, if not present, and initializes all client-server pairs
    *
    * This method reads the traceFile.txt file and initializes all client-server connections.
+   * The trace is loaded only by the first Install of a trace file (or of a cached
+   * conversion), later Install calls, from any helper, share it.
    *
    * \param clientNode pointer to client node
    * \param remoteNode pointer to server node
@@ -131,25 +349,100 @@ private:
   Time            m_startTimeOffset; //!< Start time offset
   DataRate        m_dataRate;       //!< Data Rate
   uint16_t        m_portNumber;     //!< Starting port number for connections
-  struct          m_connId          //!< Struct to uniquely identify a connection
+  uint32_t        m_numThreads;     //!< Number of threads used to decode the pcap
+  std::string     m_scratchDir;     //!< Scratch directory of the current conversion
+  bool            m_streaming;      //!< True if connections are written as soon as they are closed
+  bool            m_binaryTrace;    //!< True if trace files are written in the binary format
+  Time            m_idleTimeout;    //!< Idle time after which a connection is closed in streaming mode
+  double          m_nextIdleCheck;  //!< Packet time at which idle connections are looked for next
+  bool            m_splitClients;   //!< True if one trace file is written per client
+  std::string     m_outputDir;      //!< Directory of the trace files written by the conversion
+  std::string     m_cacheDir;       //!< Directory of the cache of converted trace files
+  TraceReplayPcapFilter m_filter;   //!< Client subnet, server ports and time window to convert
+  bool            m_timeIndex;      //!< True if the time index sidecar of the pcap is used
+  TraceReplayConversionStats m_stats; //!< Time and memory taken by the last conversion
+  uint32_t        m_maxSegmentSize; //!< Size to which larger payloads are split, 0 if they are not split
+  FILE*           m_httpPipe;       //!< Output of tshark pass for http requests
+  FILE*           m_packetPipe;     //!< Output of tshark pass for tcp packets
+  static const uint32_t NO_CONNECTION = 0xffffffff; //!< Returned by FindConnection if the connection is not found
+  static const uint32_t MAX_OPEN_TRACE_FILES = 128; //!< Trace files kept open at the same time when streaming one per client
+  struct          m_connId          //!< Struct to uniquely identify a connection, with packed addresses
   {
-    Address       ipClient;         //!< Real IP address of client
+    uint8_t       ipClient[16];     //!< Real IP address of client (network byte order, IPv4 uses first 4 bytes)
+    uint8_t       ipServer[16];     //!< Real IP address of server (network byte order, IPv4 uses first 4 bytes)
     uint16_t      portClient;       //!< Real port number of client
-    Address       ipServer;         //!< Real IP address of server
     uint16_t      portServer;       //!< Real port number of server
+    bool          ipv6;             //!< True if the addresses are IPv6
     /**
      * \brief < opertator for m_connId.
      */
     bool operator< (const m_connId& rhs) const;
+    /**
+     * \brief Checks whether rhs is the same connection in the same direction
+     */
+    bool operator== (const m_connId& rhs) const;
+    /**
+     * \brief Checks whether rhs is the same connection in the opposite direction
+     */
+    bool IsReverse (const m_connId& rhs) const;
+    /**
+     * \brief Returns the same connection in the opposite direction
+     */
+    m_connId Reverse () const;
+    /**
+     * \brief Hash of the connection, same for both directions
+     */
+    uint64_t Hash () const;
+  };
+  struct          m_tcpState        //!< Struct to track sequence and ack numbers of one direction of a connection
+  {
+    bool            seqValid;       //!< True if a segment has been seen in this direction
+    uint32_t        nextSeq;        //!< Highest sequence number seen so far (end of segment)
+    double          nextSeqTime;    //!< Time of the segment which advanced nextSeq
+    bool            ackValid;       //!< True if an ack has been seen in this direction
+    uint32_t        lastAck;        //!< Highest ack number seen so far
+    uint32_t        dupAckCount;    //!< Number of duplicate acks for lastAck
+    double          lastAckTime;    //!< Time of the last ack
+  };
+  struct          m_clientTrace     //!< Trace file of a client
+  {
+    std::string     name;           //!< File name of the trace file
+    std::ofstream*  file;           //!< Trace file being written, in the scratch directory
+    std::streampos  countPos;       //!< Position of the number of connections in the trace file (streaming mode or binary format)
+    uint32_t        numPrinted;     //!< Number of connections already written to the trace file
+    uint64_t        numPackets;     //!< Number of packets of the connections already written to the trace file
+    bool            created;        //!< True once the trace file exists in the scratch directory
+    std::list<uint32_t>::iterator lruPos; //!< Position in m_openTraces while file is open (split streaming mode)
+  };
+  struct          m_closedConn      //!< Final byte count of a connection already written in streaming mode
+  {
+    uint16_t        portClient;     //!< Real port number of client
+    uint16_t        portServer;     //!< Real port number of server
+    uint32_t        totByteCount;   //!< Total count of bytes seen in the connection
+  };
+  struct          m_connGroup       //!< Parallel connections, with the same client and server ip
+  {
+    std::vector<uint32_t>       open;   //!< m_conns indices of open connections, sorted by ports
+    std::vector<m_closedConn>   closed; //!< Connections closed in streaming mode, sorted by ports
   };
   struct          m_connInfo        //!< Struct containing details about the connection
   {
+    m_connId        id;             //!< Client and server of the connection
     Time            startTime;      //!< Start time of connections
     Time            currTime;       //!< Time of the last packet
     uint32_t        packetCount;    //!< Total count of packets in current cycle
     uint32_t        byteCount;      //!< Total count of bytes in current cycle
     uint32_t        totByteCount;   //!< Total count of bytes seen in the connection
     bool            packetC2S;      //!< Indicate whether last packet was client to server or not
+    m_tcpState      clientState;    //!< Sequence state of packets from client to server
+    m_tcpState      serverState;    //!< Sequence state of packets from server to client
+    uint32_t        group;          //!< Index of the connection's group in m_connGroups
+    uint32_t        client;         //!< Index of the connection's trace file in m_clients
+    double          lastTime;       //!< Time of the last packet, including packets without payload
+    bool            finClient;      //!< True if client has sent FIN
+    bool            finServer;      //!< True if server has sent FIN
+    bool            open;           //!< False if the slot is free (connection was written in streaming mode)
+    bool            filtered;       //!< True if the filter drops the connection, which is only kept to know its client
 
     std::vector<TraceReplayPacket>    clientPackets;    //!< List of client's packet
     std::vector<TraceReplayPacket>    serverPackets;    //!< List of server's packet
@@ -159,34 +452,124 @@ private:
     std::vector<uint32_t>             expByteServer;    //!< List of #byte expected to receive as request
   };
 
-  std::map<uint32_t, bool>        m_httpReqMap;     //!< list of frame numbers for packet which are http request
-  std::map<uint32_t, bool>        m_timeoutMap;     //!< list of frame numbers for packet which were timed out
-  std::map<m_connId, m_connInfo>  m_connMap;        //!< list of all tcp connections with details
+  std::vector<bool>               m_httpReqFrames;  //!< Bit set by frame number for packets which are http request
+  std::vector<m_connInfo>         m_conns;          //!< list of all tcp connections with details, in order of first packet
+  std::vector<uint32_t>           m_connTable;      //!< Open addressing hash table of m_conns indices (+1, 0 is empty slot)
+  std::vector<uint32_t>           m_freeConns;      //!< Free slots of m_conns
+  std::vector<m_connGroup>        m_connGroups;     //!< Connections grouped by client and server ip
+  std::map<m_connId, uint32_t>    m_connGroupMap;   //!< Index in m_connGroups for each client and server ip pair (ports are 0)
+  std::vector<m_clientTrace>      m_clients;        //!< Trace files being written (only one unless m_splitClients)
+  std::map<m_connId, uint32_t>    m_clientMap;      //!< Index in m_clients for each client ip (server ip and ports are 0)
+  std::list<uint32_t>             m_openTraces;     //!< m_clients indices of open trace files, most recently used first (split streaming mode)
   Ptr<RandomVariableStream>       m_startTimeJitter;//!< random number stream for start time
 
+  /**
+   * \brief Starts the first stage of a conversion
+   *
+   * \param start Set to the start of the stage
+   */
+  void StartStage (std::chrono::steady_clock::time_point& start);
+
+  /**
+   * \brief Records the time and peak RSS of a conversion stage which has just ended
+   *
+   * \param start Start of the stage, set to the start of the next stage
+   * \param time Set to the duration of the stage (seconds)
+   * \param rss Set to the peak RSS during the stage (KB)
+   */
+  void EndStage (std::chrono::steady_clock::time_point& start, double& time, uint64_t& rss);
+
+  /**
+   * \brief Clears the connections and trace files of any earlier conversion by this helper
+   */
+  void ClearConversion ();
+
+  /**
+   * \brief Restores the connections saved by the last AppendPcap
+   *
+   * The connections are restored with the same indices in m_conns, so
+   * the trace file is the same as if the segments were converted at once.
+   *
+   * \param path Path of the state file
+   * \param reader Opened pcap reader, its time origin is set to the one of the first segment
+   * \param closedEnd Set to the end of the connections already closed in the trace file
+   *
+   * \returns False if there is no state file
+   */
+  bool LoadAppendState (std::string path, TraceReplayPcapReader& reader, uint64_t& closedEnd);
+
+  /**
+   * \brief Saves the open connections for the next AppendPcap
+   *
+   * Must be called before the open connections are printed, as printing
+   * them adds the last request or response to each of them.
+   *
+   * \param path Temporary path to write the state to
+   * \param reader Pcap reader of the segment
+   * \param closedEnd End of the connections already closed in the trace file
+   */
+  void SaveAppendState (std::string path, const TraceReplayPcapReader& reader, uint64_t closedEnd);
+
   /**
    * \brief Converts the input pcap file to formatted trace file (tarceFile.txt)
    *
+   * Classic pcap files are decoded in-process by TraceReplayPcapReader,
+   * which also detects http requests from the start of the tcp payload.
+   * Other formats are dissected by tshark.
+   *
    */
   void ConvertPcapToTrace ();
 
   /**
    * \brief Runs the necessary tshark commands to read the input pcap file
    *
+   * Used only for the pcaps which TraceReplayPcapReader can not decode.
+   * All the commands run in parallel and their output is read through pipes.
+   * Timeouts are not taken from tshark, they are found by IsTimeout.
    */
   void RunCommands ();
 
   /**
-   * \brief Processes the httpRequest file to make list of http request packets in pcap
+   * \brief Starts tshark on the input pcap
+   *
+   * \param filter Display filter for tshark
+   * \param fields Fields to print for each matching packet
+   *
+   * \returns Pipe connected to the output of tshark
+   */
+  FILE* OpenTshark (std::string filter, std::string fields);
+
+  /**
+   * \brief Waits for tshark to finish and checks its exit status
+   *
+   * \param pipe Pipe returned by OpenTshark
+   */
+  void CloseTshark (FILE* pipe);
+
+  /**
+   * \brief Processes the http request frames from tshark to make list of http request packets in pcap
    *
    */
   void ProcessHttpList ();
 
   /**
-   * \brief Processes the timeout file to make list of timed out packets in pcap
+   * \brief Tracks sequence and ack numbers of the connection to find retransmissions due to timeout
+   *
+   * Must be called for every packet of the connection (including 0 byte packets), in frame order.
+   * Retransmissions are classified like tcp.analysis.rto of tshark: fast and spurious
+   * retransmissions, keep-alives and out of order segments are not considered as timeouts.
    *
+   * \param conn Connection of the packet
+   * \param clientPacket True if the packet is from client to server
+   * \param seq sequence number of the packet
+   * \param ack ack number of the packet
+   * \param flags tcp flags of the packet
+   * \param packetSize size of the packet
+   * \param packetTime time of the packet
+   *
+   * \returns True if the packet is a retransmission due to timeout
    */
-  void ProcessTimeoutList ();
+  bool IsTimeout (m_connInfo& conn, bool clientPacket, uint32_t seq, uint32_t ack, uint8_t flags, uint32_t packetSize, double packetTime);
 
   /**
    * \brief Reads each packet details, calculate delay and maps it to a tcp connection
@@ -198,16 +581,179 @@ private:
   void ProcessPacketList ();
 
   /**
-   * \brief Prints the trace file
+   * \brief Reads each tcp segment from the pcap reader and maps it to a tcp connection
+   *
+   * Same as ProcessPacketList, but the packet details are decoded directly
+   * from the pcap instead of the tshark output.
+   *
+   * \param reader Opened pcap reader
+   */
+  void ProcessPcap (TraceReplayPcapReader& reader);
+
+  /**
+   * \brief Decodes the pcap with a pool of worker threads and maps the segments to tcp connections
+   *
+   * Worker threads decode the chunks created by TraceReplayPcapReader::Split,
+   * while this thread merges their partial flow tables in frame order.
+   *
+   * \param reader Opened pcap reader
+   * \param numThreads Number of worker threads
+   */
+  void ProcessPcapParallel (TraceReplayPcapReader& reader, uint32_t numThreads);
+
+  /**
+   * \brief Finds the connection of a packet, inserting a new connection if
+   * the packet does not belong to a known one
+   *
+   * Both directions of a connection hash to the same slot of m_connTable,
+   * so a single probe sequence finds the connection for client and server packets.
+   * A new connection is also added to the group of connections with the
+   * same client and server ip, used to find parallel connections.
+   *
+   * \param id m_connId of the packet (source of the packet as client)
+   * \param packetTime time of the packet, start time of a new connection
+   * \param create False if a new connection must not be inserted
+   * \param clientPacket Set to true if the packet is from client to server
+   *
+   * \returns Index of the connection in m_conns, or NO_CONNECTION if not found and not created
+   */
+  uint32_t FindConnection (const m_connId& id, double packetTime, bool create, bool& clientPacket);
+
+  /**
+   * \brief Maps a tcp segment to its connection and updates the connection
+   *
+   * Used for the packets from tshark and from TraceReplayPcapReader, in frame order.
+   *
+   * \param id m_connId of the packet (source of the packet as client)
+   * \param seq sequence number of the packet
+   * \param ack ack number of the packet
+   * \param flags tcp flags of the packet
+   * \param packetSize size of the tcp payload
+   * \param packetTime time of the packet
+   * \param frameNum frame number of the packet
+   * \param httpReq True if packet starts a http request
+   */
+  void ProcessSegment (const m_connId& id, uint32_t seq, uint32_t ack, uint8_t flags, uint32_t packetSize,
+                       double packetTime, uint32_t frameNum, bool httpReq);
+
+  /**
+   * \brief Removes a connection from m_connTable
+   *
+   * \param index Index of the connection in m_conns
+   */
+  void RemoveConnection (uint32_t index);
+
+  /**
+   * \brief Writes a connection to the trace file and frees its state (streaming mode)
+   *
+   * Only the final byte count is kept, as later packets of parallel connections still refer to it.
+   *
+   * \param index Index of the connection in m_conns
+   */
+  void FinalizeConnection (uint32_t index);
+
+  /**
+   * \brief Finalizes the connections which have been idle for the idle timeout
+   *
+   * \param packetTime Time of the current packet
+   */
+  void FinalizeIdleConnections (double packetTime);
+
+  /**
+   * \brief Finds the trace file for the client of a new connection, adding it if needed
+   *
+   * \param id m_connId of the connection
+   *
+   * \returns Index of the trace file in m_clients
+   */
+  uint32_t FindClient (const m_connId& id);
+
+  /**
+   * \brief Creates the trace file of a client in the scratch directory and writes its comments
+   *
+   * \param trace Trace file to open
+   */
+  void OpenTraceFile (m_clientTrace& trace);
+
+  /**
+   * \brief Opens again the trace file of a client, to write at its end
+   *
+   * \param trace Trace file to open
+   */
+  void ReopenTraceFile (m_clientTrace& trace);
+
+  /**
+   * \brief Closes the trace file of a client which is still being written
+   *
+   * \param trace Trace file to close
+   */
+  void SuspendTraceFile (m_clientTrace& trace);
+
+  /**
+   * \brief Returns the open trace file of a client (streaming mode)
+   *
+   * With one trace file per client, only the most recently used trace files
+   * are kept open; the others are closed and opened again when needed.
+   *
+   * \param client Index of the trace file in m_clients
+   *
+   * \returns Trace file, open at its end
+   */
+  std::ofstream& GetTraceFile (uint32_t client);
+
+  /**
+   * \brief Writes the number of connections (streaming mode) and closes the trace file of a client
+   *
+   * \param trace Trace file to close
+   */
+  void CloseTraceFile (m_clientTrace& trace);
+
+  /**
+   * \brief Writes the details of a connection to the trace file
+   *
+   * \param file Trace file
+   * \param conn Connection to write
+   */
+  void PrintConnection (std::ostream& file, m_connInfo& conn);
+
+  /**
+   * \brief Appends a connection to a buffer in the binary format (see TraceReplayTrace)
+   *
+   * \param buffer Buffer to append to
+   * \param conn Connection to write, with the counts of its last cycle added
+   */
+  void WriteBinaryConnection (std::string& buffer, const m_connInfo& conn);
+
+  /**
+   * \brief Gets the extension of the trace files written by conversions
+   *
+   * \returns ".bin" for the binary format, ".txt" for the text format
+   */
+  std::string GetTraceExtension (void) const;
+
+  /**
+   * \brief Prints the remaining connections and closes the trace files
    *
+   * Trace files of different clients are written by a pool of threads.
    * Any line starting with '#' is comment.
    *
    */
   void PrintTraceFile ();
 
+  /**
+   * \brief Creates a unique scratch directory for the current conversion in m_outputDir
+   *
+   * The trace files are written in this directory, so that conversions
+   * running at the same time do not overwrite each other's files.
+   *
+   */
+  void CreateScratchDir ();
+
   /**
    * \brief Delets all the temporary files
    *
+   * Moves the trace files to m_outputDir and removes the scratch directory.
+   *
    */
   void DeleteTmpFiles ();
 
@@ -226,27 +772,113 @@ private:
   double CalculatePacketDelay (uint32_t frameNum, bool timeOut, bool httpReq, double currTime, double packetTime);
 
   /**
-   * \brief Matches the packet with the its connection and update connection details
+   * \brief Updates the connection details with the packet
    *
    *
-   * \param id m_connId of the packet
+   * \param conn Connection of the packet
+   * \param clientPacket True if the packet is from client to server
    * \param size size of the packet
    * \param time time of the packet
    * \param frameNum frame number of the packet
+   * \param timeOut True if packet was timed out
+   * \param httpReq True if packet starts a http request (ignored for packets from server)
+   *
+   */
+  void ProcessPacket (m_connInfo& conn, bool clientPacket, uint32_t size, double time, uint32_t frameNum, bool timeOut, bool httpReq);
+  /**
+   * \brief Finds the cache entry for the input pcap and the conversion parameters
+   *
+   * The pcap is hashed only once per process, as long as its size and
+   * modification time do not change.
+   *
+   * \returns Path of the cache entry (may not exist yet), or empty string if the cache is disabled
+   */
+  std::string GetCacheEntry ();
+
+  /**
+   * \brief Describes the filter settings (subnet, server ports and time window)
+   *
+   * \returns Text without white space, the same for the same settings
+   */
+  std::string GetFilterSettings () const;
+
+  /**
+   * \brief Stores the trace file of the current conversion in the cache
+   *
+   * \param entry Path returned by GetCacheEntry
+   */
+  void StoreCacheEntry (std::string entry);
+
+  /**
+   * \brief Reads the next line of the trace file, skipping the comment lines (starting with '#').
+   * Exits with an error at the end of file.
+   *
+   * \param infile input file stream
+   * \param parser Parser to read the fields of the line
+   */
+  void ReadTraceLine (std::istream& infile, TraceReplayFieldParser& parser);
+
+  /**
+   * \brief Reads a trace file line with a single count (like number of packets)
+   *
+   * \param infile input file stream
+   * \param parser Parser to read the fields of the line
+   *
+   * \returns The count
+   */
+  uint32_t ReadTraceCount (std::istream& infile, TraceReplayFieldParser& parser);
+
+  /**
+   * \brief Reads the packets of one direction of a connection from a text trace file
+   *
+   * \param infile input file stream
+   * \param parser Parser to read the fields of the line
+   * \param packets Vector to fill with the packets
+   */
+  void ReadTracePackets (std::istream& infile, TraceReplayFieldParser& parser, std::vector<TraceReplayPacket>& packets);
+
+  /**
+   * \brief Reads a list of counts (like packets per request) from a text trace file
+   *
+   * \param infile input file stream
+   * \param parser Parser to read the fields of the line
+   * \param counts Vector to fill with the counts
+   */
+  void ReadTraceCounts (std::istream& infile, TraceReplayFieldParser& parser, std::vector<uint32_t>& counts);
+
+  /**
+   * \brief Reads a connection from a text trace file
    *
+   * \param infile input file stream
+   * \param parser Parser to read the fields of the line
+   * \param conn Connection to fill (only its id, start time, packets and counts)
    */
-  void ProcessPacket (m_connId id, uint32_t size, double time, uint32_t frameNum);
+  void ReadTraceConnection (std::istream& infile, TraceReplayFieldParser& parser, m_connInfo& conn);
+
   /**
-   * \brief Checks the input file for regular expression match.
-   * Skips the comment lines (starting with '#').
+   * \brief Loads a text trace file in the binary layout
    *
+   * Connections are converted one at a time and written to an unlinked
+   * temporary file in the output directory, which is then mapped. The trace
+   * is built in memory if no temporary file can be written.
    *
    * \param infile input file stream
-   * \param reg Regular expression
+   * \param filename Name of the trace file, for error messages
+   *
+   * \returns Trace read from the file
+   */
+  Ptr<const TraceReplayTrace> LoadTextTrace (std::istream& infile, std::string filename);
+
+  /**
+   * \brief Creates the client and server applications of a connection of a trace file
    *
-   * \returns line (string) if regex matches
+   * \param trace Trace file
+   * \param index Index of the connection in the trace file, gives its port number
+   * \param clientNode pointer to client node
+   * \param remoteNode pointer to server node
+   * \param remoteAddress Server Ip address
    */
-  std::string CheckRegex (std::ifstream& infile, std::regex reg);
+  void InstallConnection (Ptr<const TraceReplayTrace> trace, uint32_t index, Ptr<Node> clientNode, Ptr<Node> remoteNode, Address remoteAddress);
 };
 
 } // namespace ns3
@@ -0,0 +1,1540 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ */
+
+#include "ns3/log.h"
+#include "trace-replay-pcap-reader.h"
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TraceReplayPcapReader");
+
+// pcap magic numbers, as read in native byte order
+static const uint32_t PCAP_MAGIC = 0xa1b2c3d4;
+static const uint32_t PCAP_MAGIC_SWAPPED = 0xd4c3b2a1;
+static const uint32_t PCAP_NSEC_MAGIC = 0xa1b23c4d;
+static const uint32_t PCAP_NSEC_MAGIC_SWAPPED = 0x4d3cb2a1;
+
+// pcapng block types and byte order magic
+static const uint32_t PCAPNG_SECTION_HEADER = 0x0a0d0d0a;
+static const uint32_t PCAPNG_INTERFACE = 1;
+static const uint32_t PCAPNG_PACKET = 2;
+static const uint32_t PCAPNG_SIMPLE_PACKET = 3;
+static const uint32_t PCAPNG_ENHANCED_PACKET = 6;
+static const uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+static const uint32_t PCAPNG_BYTE_ORDER_MAGIC_SWAPPED = 0x4d3c2b1a;
+
+// Upper limit on the length of a pcapng block, options included
+static const uint64_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+// Time index sidecar: magic ("TRIDX" and format version 1), and time between two entries (seconds)
+static const uint64_t TIME_INDEX_MAGIC = 0x0158444952540000ULL;
+static const double TIME_INDEX_INTERVAL = 10.0;
+
+// Size of the blocks read from a compressed stream, and number of blocks read ahead
+static const uint32_t STREAM_BLOCK_SIZE = 1024 * 1024;
+static const uint32_t STREAM_BLOCKS_AHEAD = 8;
+
+// link types understood by DecodeFrame
+static const uint32_t LINKTYPE_ETHERNET = 1;
+static const uint32_t LINKTYPE_RAW = 101;
+static const uint32_t LINKTYPE_IEEE802_11 = 105;
+static const uint32_t LINKTYPE_LINUX_SLL = 113;
+static const uint32_t LINKTYPE_IEEE802_11_RADIOTAP = 127;
+static const uint32_t LINKTYPE_LINUX_SLL2 = 276;
+
+// Request methods recognized by IsHttpMethod, each followed by a space
+static const char* const HTTP_METHODS[] = {
+  "GET ", "POST ", "HEAD ", "PUT ", "DELETE ", "OPTIONS ", "CONNECT ", "TRACE ", "PATCH ",
+  "PROPFIND ", "PROPPATCH ", "MKCOL ", "COPY ", "MOVE ", "LOCK ", "UNLOCK ", "SEARCH "
+};
+
+// Upper limit on the captured length of a frame. Anything bigger means the file is corrupted.
+static const uint32_t MAX_FRAME_SIZE = 262144;
+
+static inline uint16_t
+ReadNetUint16 (const uint8_t* data)
+{
+  return (data[0] << 8) | data[1];
+}
+
+static inline uint32_t
+ReadNetUint32 (const uint8_t* data)
+{
+  return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+}
+
+bool
+TraceReplayPcapFlow::operator< (const TraceReplayPcapFlow& rhs) const
+{
+  if (ipv6 != rhs.ipv6)
+    {
+      return ipv6 < rhs.ipv6;
+    }
+  if (portSrc != rhs.portSrc)
+    {
+      return portSrc < rhs.portSrc;
+    }
+  if (portDst != rhs.portDst)
+    {
+      return portDst < rhs.portDst;
+    }
+  int cmp = std::memcmp (ipSrc, rhs.ipSrc, sizeof (ipSrc));
+  if (cmp != 0)
+    {
+      return cmp < 0;
+    }
+  return std::memcmp (ipDst, rhs.ipDst, sizeof (ipDst)) < 0;
+}
+
+TraceReplayPcapFilter::TraceReplayPcapFilter ()
+{
+  subnet = false;
+  ipv6 = false;
+  std::memset (network, 0, sizeof (network));
+  std::memset (mask, 0, sizeof (mask));
+  start = 0;
+  end = std::numeric_limits<double>::infinity ();
+}
+
+bool
+TraceReplayPcapFilter::IsEmpty () const
+{
+  return !subnet && serverPorts.empty () && start <= 0 && end == std::numeric_limits<double>::infinity ();
+}
+
+bool
+TraceReplayPcapFilter::MatchesTime (double time) const
+{
+  return time >= start && time <= end;
+}
+
+bool
+TraceReplayPcapFilter::IsClient (const uint8_t* ip) const
+{
+  uint32_t length = ipv6 ? 16 : 4;
+  for (uint32_t i = 0; i < length; i++)
+    {
+      if ((ip[i] & mask[i]) != network[i])
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+bool
+TraceReplayPcapFilter::MatchesFlow (bool ipv6, const uint8_t* ipSrc, const uint8_t* ipDst, uint16_t portSrc, uint16_t portDst) const
+{
+  if (subnet && ipv6 != this->ipv6)
+    {
+      return false;
+    }
+  // Either direction of a connection between a client and a server port
+  bool toServer = (!subnet || IsClient (ipSrc)) && (serverPorts.empty () || serverPorts[portDst]);
+  bool toClient = (!subnet || IsClient (ipDst)) && (serverPorts.empty () || serverPorts[portSrc]);
+  return toServer || toClient;
+}
+
+bool
+TraceReplayPcapFilter::MatchesConnection (bool ipv6, const uint8_t* ipClient, uint16_t portServer) const
+{
+  if (subnet && (ipv6 != this->ipv6 || !IsClient (ipClient)))
+    {
+      return false;
+    }
+  return serverPorts.empty () || serverPorts[portServer];
+}
+
+bool
+TraceReplayPcapFilter::FiltersClients () const
+{
+  return subnet || !serverPorts.empty ();
+}
+
+TraceReplayPcapReader::TraceReplayPcapReader ()
+{
+  NS_LOG_FUNCTION (this);
+  m_data = 0;
+  m_size = 0;
+  m_offset = 0;
+  m_pcapng = false;
+  m_swapped = false;
+  m_nanosecond = false;
+  m_interfaceBase = 0;
+  m_frameNum = 0;
+  m_firstFrame = true;
+  m_simpleWarned = false;
+  m_firstSec = 0;
+  m_firstFrac = 0;
+  m_stopOffset = 0;
+  m_mtime = 0;
+  m_indexBuild = false;
+  m_nextIndexTime = 0;
+  m_stream = 0;
+  m_process = false;
+  m_streamEnd = false;
+  m_streamStop = false;
+  m_streamDrained = false;
+  m_bufferPos = 0;
+}
+
+TraceReplayPcapReader::~TraceReplayPcapReader ()
+{
+  NS_LOG_FUNCTION (this);
+  Close ();
+}
+
+static inline uint32_t
+ReadFileUint32 (const uint8_t* data, bool swapped)
+{
+  uint32_t val;
+  std::memcpy (&val, data, sizeof (val));
+  if (swapped)
+    {
+      val = ((val & 0xff) << 24) | ((val & 0xff00) << 8) | ((val >> 8) & 0xff00) | (val >> 24);
+    }
+  return val;
+}
+
+static inline uint16_t
+ReadFileUint16 (const uint8_t* data, bool swapped)
+{
+  uint16_t val;
+  std::memcpy (&val, data, sizeof (val));
+  if (swapped)
+    {
+      val = (val << 8) | (val >> 8);
+    }
+  return val;
+}
+
+bool
+TraceReplayPcapReader::Open (std::string path)
+{
+  NS_LOG_FUNCTION (this << path);
+  Close ();
+  m_path = path;
+  m_offset = 0;
+  m_interfaces.clear ();
+  m_interfaceBase = 0;
+  m_frameNum = 0;
+  m_firstFrame = true;
+  m_simpleWarned = false;
+  m_stopOffset = std::numeric_limits<uint64_t>::max ();
+  m_indexPath = "";
+  m_indexBuild = false;
+  m_index.clear ();
+  int fd = open (path.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0)
+    {
+      close (fd);
+      return false;
+    }
+  if (!S_ISREG (st.st_mode))
+    {
+      // Pipes can only be read once, from start to end
+      if (!OpenStream ("", fd))
+        {
+          return false;
+        }
+      return ReadFileHeader ();
+    }
+
+  uint8_t magic[4] = { 0, 0, 0, 0 };
+  if (pread (fd, magic, sizeof (magic), 0) != sizeof (magic))
+    {
+      close (fd);
+      return false;
+    }
+  std::string decompressor;
+  if (magic[0] == 0x1f && magic[1] == 0x8b)
+    {
+      decompressor = "gzip -dc";
+    }
+  else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+    {
+      decompressor = "zstd -dcq";
+    }
+  if (!decompressor.empty ())
+    {
+      close (fd);
+      // Quote the pcap path for the shell
+      std::string quoted = "'";
+      for (uint32_t i = 0; i < path.size (); i++)
+        {
+          if (path[i] == '\'')
+            {
+              quoted += "'\\''";
+            }
+          else
+            {
+              quoted += path[i];
+            }
+        }
+      quoted += "'";
+      if (!OpenStream (decompressor + " < " + quoted, -1))
+        {
+          return false;
+        }
+      return ReadFileHeader ();
+    }
+
+  // The mapping stays valid after closing the descriptor
+  void* data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      NS_LOG_INFO ("Could not map " << path);
+      return false;
+    }
+  m_data = static_cast<const uint8_t*> (data);
+  m_size = st.st_size;
+  m_mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  madvise (data, m_size, MADV_SEQUENTIAL);
+  return ReadFileHeader ();
+}
+
+bool
+TraceReplayPcapReader::ReadFileHeader ()
+{
+  NS_LOG_FUNCTION (this);
+  const uint8_t* header = Peek (24);
+  if (header == 0)
+    {
+      Close ();
+      return false;
+    }
+  uint32_t magic;
+  std::memcpy (&magic, header, sizeof (magic));
+  if (magic == PCAPNG_SECTION_HEADER)
+    {
+      m_pcapng = true;
+      m_nanosecond = true;
+      m_swapped = false;
+      // Interfaces are described before the first packet, other blocks are skipped
+      bool supported = true;
+      while ((header = Peek (HeaderSize ())) != 0)
+        {
+          bool swapped = m_swapped;
+          uint32_t type = ReadFileUint32 (header, swapped);
+          if (type == PCAPNG_ENHANCED_PACKET || type == PCAPNG_PACKET || type == PCAPNG_SIMPLE_PACKET)
+            {
+              break;
+            }
+          uint64_t length = BlockLength (header, swapped, 1);
+          const uint8_t* data = Peek (length);
+          if (data == 0)
+            {
+              break;
+            }
+          Consume (length);
+          m_swapped = swapped;
+          if (type == PCAPNG_SECTION_HEADER)
+            {
+              m_interfaceBase = m_interfaces.size ();
+              continue;
+            }
+          if (type != PCAPNG_INTERFACE)
+            {
+              continue;
+            }
+          AddInterface (data, length, m_swapped);
+          uint32_t linkType = m_interfaces.back ().linkType;
+          if (!IsSupportedLinkType (linkType))
+            {
+              NS_LOG_INFO ("Link type " << linkType << " is not supported");
+              supported = false;
+            }
+        }
+      if (!supported || m_interfaces.empty ())
+        {
+          Close ();
+          return false;
+        }
+      return true;
+    }
+
+  // Global header: magic, version (2 x 16 bit), thiszone, sigfigs, snaplen, network
+  m_pcapng = false;
+  if (magic == PCAP_MAGIC || magic == PCAP_NSEC_MAGIC)
+    {
+      m_swapped = false;
+    }
+  else if (magic == PCAP_MAGIC_SWAPPED || magic == PCAP_NSEC_MAGIC_SWAPPED)
+    {
+      m_swapped = true;
+    }
+  else
+    {
+      NS_LOG_INFO ("Not a pcap or pcapng file");
+      Close ();
+      return false;
+    }
+  m_nanosecond = (magic == PCAP_NSEC_MAGIC || magic == PCAP_NSEC_MAGIC_SWAPPED);
+
+  m_interface interface;
+  interface.linkType = ReadFileUint32 (header + 20, m_swapped);
+  interface.tsResolution = m_nanosecond ? 9 : 6;
+  if (!IsSupportedLinkType (interface.linkType))
+    {
+      NS_LOG_INFO ("Link type " << interface.linkType << " is not supported");
+      Close ();
+      return false;
+    }
+  m_interfaces.push_back (interface);
+  Consume (24);
+  return true;
+}
+
+bool
+TraceReplayPcapReader::OpenStream (std::string command, int fd)
+{
+  NS_LOG_FUNCTION (this << command);
+  if (command.empty ())
+    {
+      m_stream = fdopen (fd, "rb");
+      m_process = false;
+    }
+  else
+    {
+      m_stream = popen (command.c_str (), "r");
+      m_process = true;
+    }
+  if (m_stream == 0)
+    {
+      NS_LOG_INFO ("Could not open the stream of " << m_path);
+      if (command.empty ())
+        {
+          close (fd);
+        }
+      return false;
+    }
+  m_streamEnd = false;
+  m_streamStop = false;
+  m_streamDrained = false;
+  m_buffer.clear ();
+  m_bufferPos = 0;
+  m_streamThread = std::thread (&TraceReplayPcapReader::ReadStream, this);
+  return true;
+}
+
+void
+TraceReplayPcapReader::ReadStream ()
+{
+  // Runs while the caller decodes the previous blocks
+  while (true)
+    {
+      std::vector<uint8_t> block (STREAM_BLOCK_SIZE);
+      size_t numRead = fread (&block[0], 1, block.size (), m_stream);
+      block.resize (numRead);
+
+      std::unique_lock<std::mutex> lock (m_streamMutex);
+      while (m_blocks.size () >= STREAM_BLOCKS_AHEAD && !m_streamStop)
+        {
+          m_streamCond.wait (lock);
+        }
+      if (m_streamStop)
+        {
+          return;
+        }
+      if (numRead > 0)
+        {
+          m_blocks.push_back (std::vector<uint8_t> ());
+          m_blocks.back ().swap (block);
+        }
+      if (numRead < STREAM_BLOCK_SIZE)
+        {
+          m_streamEnd = true;
+        }
+      m_streamCond.notify_all ();
+      if (m_streamEnd)
+        {
+          return;
+        }
+    }
+}
+
+const uint8_t*
+TraceReplayPcapReader::Peek (uint64_t length)
+{
+  if (m_data != 0)
+    {
+      return m_offset + length <= m_size ? m_data + m_offset : 0;
+    }
+  if (m_stream == 0)
+    {
+      return 0;
+    }
+  while (m_buffer.size () - m_bufferPos < length)
+    {
+      std::vector<uint8_t> block;
+      {
+        std::unique_lock<std::mutex> lock (m_streamMutex);
+        while (m_blocks.empty () && !m_streamEnd)
+          {
+            m_streamCond.wait (lock);
+          }
+        if (m_blocks.empty ())
+          {
+            m_streamDrained = true;
+            return 0;
+          }
+        block.swap (m_blocks.front ());
+        m_blocks.pop_front ();
+      }
+      m_streamCond.notify_all ();
+      // Keep only the bytes not consumed yet, records are seldom split across blocks
+      m_buffer.erase (m_buffer.begin (), m_buffer.begin () + m_bufferPos);
+      m_bufferPos = 0;
+      if (m_buffer.empty ())
+        {
+          m_buffer.swap (block);
+        }
+      else
+        {
+          m_buffer.insert (m_buffer.end (), block.begin (), block.end ());
+        }
+    }
+  return &m_buffer[m_bufferPos];
+}
+
+void
+TraceReplayPcapReader::Consume (uint64_t length)
+{
+  m_offset += length;
+  if (m_data == 0)
+    {
+      m_bufferPos += length;
+    }
+}
+
+void
+TraceReplayPcapReader::Close ()
+{
+  NS_LOG_FUNCTION (this);
+  if (m_data != 0)
+    {
+      munmap (const_cast<uint8_t*> (m_data), m_size);
+      m_data = 0;
+      m_size = 0;
+    }
+  if (m_stream != 0)
+    {
+      {
+        std::lock_guard<std::mutex> lock (m_streamMutex);
+        m_streamStop = true;
+      }
+      m_streamCond.notify_all ();
+      m_streamThread.join ();
+      // An early stop kills the decompressor with SIGPIPE, that is not an error
+      bool complete = m_streamDrained;
+      int status = m_process ? pclose (m_stream) : fclose (m_stream);
+      m_stream = 0;
+      m_blocks.clear ();
+      std::vector<uint8_t> ().swap (m_buffer);
+      m_bufferPos = 0;
+      if (complete && status != 0)
+        {
+          std::cerr << "Error decompressing input pcap file.\n";
+          exit (1);
+        }
+    }
+}
+
+bool
+TraceReplayPcapReader::CanSplit () const
+{
+  return m_data != 0;
+}
+
+uint32_t
+TraceReplayPcapReader::HeaderSize () const
+{
+  return m_pcapng ? 12 : 16;
+}
+
+uint64_t
+TraceReplayPcapReader::BlockLength (const uint8_t* header, bool& swapped, uint32_t frameNum) const
+{
+  if (!m_pcapng)
+    {
+      // Record header: ts_sec, ts_usec (or ts_nsec), incl_len, orig_len
+      uint32_t capLen = ReadFileUint32 (header + 8, swapped);
+      if (capLen > MAX_FRAME_SIZE)
+        {
+          std::cerr << "Input pcap file is corrupted (frame " << frameNum << ").\n";
+          exit (1);
+        }
+      return 16 + capLen;
+    }
+
+  // Block header: type, total length, and for section header the byte order magic
+  uint32_t type = ReadFileUint32 (header, swapped);
+  if (type == PCAPNG_SECTION_HEADER)
+    {
+      uint32_t magic = ReadFileUint32 (header + 8, false);
+      if (magic == PCAPNG_BYTE_ORDER_MAGIC)
+        {
+          swapped = false;
+        }
+      else if (magic == PCAPNG_BYTE_ORDER_MAGIC_SWAPPED)
+        {
+          swapped = true;
+        }
+      else
+        {
+          std::cerr << "Input pcap file is corrupted (section header before frame " << frameNum << ").\n";
+          exit (1);
+        }
+    }
+  uint64_t length = ReadFileUint32 (header + 4, swapped);
+  // Captured length of the frames is checked by ParseBlock, options can make a packet block longer
+  if (length < 12 || length % 4 != 0 || length > MAX_BLOCK_SIZE)
+    {
+      std::cerr << "Input pcap file is corrupted (frame " << frameNum << ").\n";
+      exit (1);
+    }
+  return length;
+}
+
+void
+TraceReplayPcapReader::WarnSimplePacket (void)
+{
+  // A simple packet block has no timestamp, so its frame can not be given a
+  // time in the trace. It still counts as a frame, like in tshark.
+  if (!m_simpleWarned)
+    {
+      NS_LOG_WARN ("Pcapng simple packet blocks have no timestamp, their frames are skipped");
+      m_simpleWarned = true;
+    }
+}
+
+void
+TraceReplayPcapReader::ParseBlock (const uint8_t* data, uint64_t length, bool swapped, uint32_t interfaceBase,
+                                   uint32_t frameNum, m_block& block) const
+{
+  if (!m_pcapng)
+    {
+      block.type = PCAPNG_ENHANCED_PACKET;
+      block.packet = true;
+      block.interface = 0;
+      block.sec = ReadFileUint32 (data, swapped);
+      block.frac = ReadFileUint32 (data + 4, swapped);
+      block.capLen = length - 16;
+      block.frame = data + 16;
+      return;
+    }
+
+  block.type = ReadFileUint32 (data, swapped);
+  block.packet = false;
+  uint64_t ticks = 0;
+  if (block.type == PCAPNG_ENHANCED_PACKET || block.type == PCAPNG_PACKET)
+    {
+      // interface id (16 bit with drops count in obsolete packet block),
+      // timestamp high and low, captured length, original length
+      if (length < 32)
+        {
+          std::cerr << "Input pcap file is corrupted (frame " << frameNum << ").\n";
+          exit (1);
+        }
+      block.interface = block.type == PCAPNG_PACKET ? ReadFileUint16 (data + 8, swapped) : ReadFileUint32 (data + 8, swapped);
+      ticks = ((uint64_t) ReadFileUint32 (data + 12, swapped) << 32) | ReadFileUint32 (data + 16, swapped);
+      block.capLen = ReadFileUint32 (data + 20, swapped);
+      block.frame = data + 28;
+      if (block.capLen > MAX_FRAME_SIZE || 28 + (uint64_t) block.capLen + 4 > length)
+        {
+          std::cerr << "Input pcap file is corrupted (frame " << frameNum << ").\n";
+          exit (1);
+        }
+    }
+  else if (block.type == PCAPNG_SIMPLE_PACKET)
+    {
+      // No timestamp, the frame is counted but not decoded (see WarnSimplePacket)
+      block.interface = 0;
+      block.capLen = 0;
+      block.frame = data + 12;
+    }
+  else
+    {
+      return;
+    }
+  block.packet = true;
+  block.interface += interfaceBase;
+  if (block.interface >= m_interfaces.size ())
+    {
+      std::cerr << "Input pcap file is corrupted (frame " << frameNum << " uses an undefined interface).\n";
+      exit (1);
+    }
+
+  // Timestamps are converted to seconds and nanoseconds
+  uint8_t resolution = m_interfaces[block.interface].tsResolution;
+  if (resolution & 0x80)
+    {
+      uint32_t shift = std::min<uint32_t> (resolution & 0x7f, 63);
+      uint64_t unitsPerSec = (uint64_t) 1 << shift;
+      block.sec = ticks >> shift;
+      block.frac = (uint32_t) ((double) (ticks & (unitsPerSec - 1)) * 1e9 / (double) unitsPerSec);
+    }
+  else
+    {
+      uint64_t unitsPerSec = 1;
+      for (uint32_t i = 0; i < resolution && i < 19; i++)
+        {
+          unitsPerSec *= 10;
+        }
+      block.sec = ticks / unitsPerSec;
+      uint64_t rem = ticks % unitsPerSec;
+      if (resolution <= 9)
+        {
+          for (uint32_t i = resolution; i < 9; i++)
+            {
+              rem *= 10;
+            }
+        }
+      else
+        {
+          for (uint32_t i = 9; i < resolution && i < 19; i++)
+            {
+              rem /= 10;
+            }
+        }
+      block.frac = rem;
+    }
+}
+
+void
+TraceReplayPcapReader::AddInterface (const uint8_t* data, uint64_t length, bool swapped)
+{
+  // link type, reserved, snaplen, then options till the block trailer
+  m_interface interface;
+  interface.linkType = length >= 20 ? ReadFileUint16 (data + 8, swapped) : 0;
+  interface.tsResolution = 6;
+  uint64_t offset = 16;
+  while (offset + 4 <= length - 4)
+    {
+      uint16_t code = ReadFileUint16 (data + offset, swapped);
+      uint16_t optionLength = ReadFileUint16 (data + offset + 2, swapped);
+      if (code == 0 || offset + 4 + optionLength > length - 4)
+        {
+          break;
+        }
+      if (code == 9 && optionLength >= 1)
+        {
+          // if_tsresol
+          interface.tsResolution = data[offset + 4];
+        }
+      offset += 4 + ((optionLength + 3) & ~3);
+    }
+  if (!IsSupportedLinkType (interface.linkType))
+    {
+      NS_LOG_WARN ("Frames of link type " << interface.linkType << " will not be decoded");
+    }
+  m_interfaces.push_back (interface);
+}
+
+bool
+TraceReplayPcapReader::ReadNext (TraceReplayPcapRecord& record)
+{
+  m_block block;
+  const uint8_t* header;
+  while (m_offset < m_stopOffset && (header = Peek (HeaderSize ())) != 0)
+    {
+      uint64_t length = BlockLength (header, m_swapped, m_frameNum + 1);
+      const uint8_t* data = Peek (length);
+      if (data == 0)
+        {
+          NS_LOG_WARN ("Pcap file was cut short in the middle of frame " << m_frameNum + 1);
+          return false;
+        }
+      uint64_t offset = m_offset;
+      Consume (length);
+      ParseBlock (data, length, m_swapped, m_interfaceBase, m_frameNum + 1, block);
+      if (block.type == PCAPNG_SECTION_HEADER)
+        {
+          m_interfaceBase = m_interfaces.size ();
+          continue;
+        }
+      if (block.type == PCAPNG_INTERFACE)
+        {
+          AddInterface (data, length, m_swapped);
+          continue;
+        }
+      if (!block.packet)
+        {
+          continue;
+        }
+      if (block.type == PCAPNG_SIMPLE_PACKET)
+        {
+          WarnSimplePacket ();
+          m_frameNum++;
+          continue;
+        }
+
+      if (m_firstFrame)
+        {
+          m_firstSec = block.sec;
+          m_firstFrac = block.frac;
+          m_firstFrame = false;
+        }
+      double time = RelativeTime (block.sec, block.frac);
+      if (m_indexBuild)
+        {
+          IndexFrame (offset, m_frameNum, time);
+        }
+      m_frameNum++;
+
+      // Frame is decoded in place, payload points into the mapping or the stream buffer
+      if (block.capLen == 0 || !m_filter.MatchesTime (time)
+          || !DecodeFrame (m_interfaces[block.interface].linkType, block.frame, block.capLen, record, &m_filter))
+        {
+          continue;
+        }
+      record.time = time - m_filter.start;
+      record.frameNum = m_frameNum;
+      return true;
+    }
+  if (m_offset < m_stopOffset && Peek (1) != 0)
+    {
+      NS_LOG_WARN ("Pcap file was cut short in the middle of frame " << m_frameNum + 1);
+    }
+  if (m_indexBuild)
+    {
+      SaveTimeIndex ();
+    }
+  return false;
+}
+
+double
+TraceReplayPcapReader::RelativeTime (uint64_t sec, uint32_t frac) const
+{
+  // time relative to the first frame, same as frame.time_relative in tshark
+  double scale = m_nanosecond ? 1e-9 : 1e-6;
+  return ((double) sec - (double) m_firstSec) + ((double) frac - (double) m_firstFrac) * scale;
+}
+
+void
+TraceReplayPcapReader::SetTimeOrigin (uint64_t sec, uint32_t nsec)
+{
+  NS_LOG_FUNCTION (this << sec << nsec);
+  m_firstSec = sec;
+  m_firstFrac = m_nanosecond ? nsec : nsec / 1000;
+  m_firstFrame = false;
+}
+
+bool
+TraceReplayPcapReader::GetTimeOrigin (uint64_t& sec, uint32_t& nsec) const
+{
+  if (m_firstFrame)
+    {
+      return false;
+    }
+  sec = m_firstSec;
+  nsec = m_nanosecond ? m_firstFrac : m_firstFrac * 1000;
+  return true;
+}
+
+void
+TraceReplayPcapReader::Split (uint32_t numChunks, std::vector<TraceReplayPcapChunk>& chunks)
+{
+  NS_LOG_FUNCTION (this << numChunks);
+  chunks.clear ();
+  if (numChunks == 0)
+    {
+      numChunks = 1;
+    }
+  if (m_data == 0)
+    {
+      return;
+    }
+
+  uint64_t start = m_offset;
+  uint64_t stop = std::min (m_size, m_stopOffset);
+  uint64_t chunkSize = (stop - std::min (start, stop)) / numChunks + 1;
+
+  TraceReplayPcapChunk chunk;
+  chunk.offset = start;
+  chunk.end = start;
+  chunk.firstFrame = m_frameNum + 1;
+  chunk.swapped = m_swapped;
+  chunk.interfaceBase = m_interfaceBase;
+
+  // Walk only the record headers, frame data is not touched
+  uint64_t offset = start;
+  uint32_t frameNum = m_frameNum;
+  m_block block;
+  while (offset < stop && offset + HeaderSize () <= m_size)
+    {
+      const uint8_t* header = m_data + offset;
+      bool swapped = m_swapped;
+      uint64_t length = BlockLength (header, swapped, frameNum + 1);
+      if (offset + length > m_size)
+        {
+          NS_LOG_WARN ("Pcap file was cut short in the middle of frame " << frameNum + 1);
+          break;
+        }
+      ParseBlock (header, length, swapped, m_interfaceBase, frameNum + 1, block);
+      bool section = block.type == PCAPNG_SECTION_HEADER;
+      if (section)
+        {
+          // A chunk is decoded with the byte order and interfaces of a single section
+          m_swapped = swapped;
+          m_interfaceBase = m_interfaces.size ();
+        }
+      else if (block.type == PCAPNG_INTERFACE)
+        {
+          AddInterface (header, length, m_swapped);
+        }
+      else if (block.type == PCAPNG_SIMPLE_PACKET)
+        {
+          WarnSimplePacket ();
+        }
+      else if (block.packet)
+        {
+          if (m_firstFrame)
+            {
+              m_firstSec = block.sec;
+              m_firstFrac = block.frac;
+              m_firstFrame = false;
+            }
+          if (m_indexBuild)
+            {
+              IndexFrame (offset, frameNum, RelativeTime (block.sec, block.frac));
+            }
+        }
+      if (offset > chunk.offset && (section || offset - chunk.offset >= chunkSize))
+        {
+          // Close the current chunk at this record boundary
+          chunk.end = offset;
+          chunks.push_back (chunk);
+          chunk.offset = offset;
+          chunk.firstFrame = frameNum + 1;
+          chunk.swapped = m_swapped;
+          chunk.interfaceBase = m_interfaceBase;
+        }
+      else if (section)
+        {
+          chunk.swapped = m_swapped;
+          chunk.interfaceBase = m_interfaceBase;
+        }
+      offset += length;
+      if (block.packet)
+        {
+          frameNum++;
+        }
+    }
+  chunk.end = offset;
+  if (chunk.end > chunk.offset)
+    {
+      chunks.push_back (chunk);
+    }
+  m_offset = offset;
+  m_frameNum = frameNum;
+  if (m_indexBuild)
+    {
+      SaveTimeIndex ();
+    }
+  // Chunks are decoded in random order, only the part of the file they cover is read
+  uint64_t pageSize = sysconf (_SC_PAGESIZE);
+  uint64_t first = start / pageSize * pageSize;
+  madvise (const_cast<uint8_t*> (m_data) + first, offset - first, MADV_WILLNEED);
+}
+
+void
+TraceReplayPcapReader::UseTimeIndex (std::string path)
+{
+  NS_LOG_FUNCTION (this << path);
+  if (m_data == 0 || m_frameNum != 0)
+    {
+      // Streams can not seek, and the index needs the whole file to be read once
+      return;
+    }
+  m_indexPath = path;
+  if (!LoadTimeIndex ())
+    {
+      m_index.clear ();
+      m_indexBuild = true;
+      m_nextIndexTime = 0;
+      return;
+    }
+
+  // Timestamps may go back a little, so one more interval is read on both sides
+  double start = m_filter.start - TIME_INDEX_INTERVAL;
+  double end = m_filter.end + TIME_INDEX_INTERVAL;
+  for (uint32_t i = 0; i < m_index.size (); i++)
+    {
+      if (m_index[i].time > end)
+        {
+          m_stopOffset = m_index[i].offset;
+          break;
+        }
+    }
+  const m_indexEntry* seek = 0;
+  for (uint32_t i = 0; i < m_index.size () && m_index[i].time <= start; i++)
+    {
+      seek = &m_index[i];
+    }
+  if (seek != 0)
+    {
+      NS_LOG_INFO ("Time index: reading from offset " << seek->offset << " (frame " << seek->frameNum + 1 << ")");
+      m_offset = seek->offset;
+      m_frameNum = seek->frameNum;
+      m_swapped = seek->swapped;
+      m_interfaceBase = seek->interfaceBase;
+      // Interfaces described later in the file are added again as they are read
+      m_interfaces.assign (m_indexInterfaces.begin (), m_indexInterfaces.begin () + seek->numInterfaces);
+    }
+}
+
+void
+TraceReplayPcapReader::IndexFrame (uint64_t offset, uint32_t frameNum, double time)
+{
+  if (time < m_nextIndexTime)
+    {
+      return;
+    }
+  m_indexEntry entry;
+  entry.time = time;
+  entry.offset = offset;
+  entry.frameNum = frameNum;
+  entry.numInterfaces = m_interfaces.size ();
+  entry.interfaceBase = m_interfaceBase;
+  entry.swapped = m_swapped;
+  m_index.push_back (entry);
+  m_nextIndexTime = (std::floor (time / TIME_INDEX_INTERVAL) + 1) * TIME_INDEX_INTERVAL;
+}
+
+bool
+TraceReplayPcapReader::LoadTimeIndex ()
+{
+  NS_LOG_FUNCTION (this);
+  std::ifstream file (m_indexPath.c_str (), std::ios::binary);
+  // Header: magic, pcap size and modification time, first frame's timestamp, table sizes
+  uint64_t magic = 0;
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  uint64_t firstSec = 0;
+  uint32_t firstFrac = 0;
+  uint32_t numInterfaces = 0;
+  uint32_t numEntries = 0;
+  file.read (reinterpret_cast<char*> (&magic), sizeof (magic));
+  file.read (reinterpret_cast<char*> (&size), sizeof (size));
+  file.read (reinterpret_cast<char*> (&mtime), sizeof (mtime));
+  file.read (reinterpret_cast<char*> (&firstSec), sizeof (firstSec));
+  file.read (reinterpret_cast<char*> (&firstFrac), sizeof (firstFrac));
+  file.read (reinterpret_cast<char*> (&numInterfaces), sizeof (numInterfaces));
+  file.read (reinterpret_cast<char*> (&numEntries), sizeof (numEntries));
+  if (!file || magic != TIME_INDEX_MAGIC || size != m_size || mtime != m_mtime)
+    {
+      NS_LOG_INFO ("No valid time index in " << m_indexPath);
+      return false;
+    }
+  m_indexInterfaces.resize (numInterfaces);
+  for (uint32_t i = 0; i < numInterfaces; i++)
+    {
+      uint32_t value[2];
+      file.read (reinterpret_cast<char*> (value), sizeof (value));
+      m_indexInterfaces[i].linkType = value[0];
+      m_indexInterfaces[i].tsResolution = value[1];
+    }
+  m_index.resize (numEntries);
+  if (numEntries > 0)
+    {
+      file.read (reinterpret_cast<char*> (&m_index[0]), numEntries * sizeof (m_indexEntry));
+    }
+  if (!file)
+    {
+      NS_LOG_INFO ("Time index " << m_indexPath << " is cut short");
+      return false;
+    }
+  for (uint32_t i = 0; i < numEntries; i++)
+    {
+      if (m_index[i].offset >= m_size || m_index[i].numInterfaces > numInterfaces)
+        {
+          return false;
+        }
+    }
+  m_firstSec = firstSec;
+  m_firstFrac = firstFrac;
+  m_firstFrame = false;
+  return true;
+}
+
+void
+TraceReplayPcapReader::SaveTimeIndex ()
+{
+  NS_LOG_FUNCTION (this);
+  m_indexBuild = false;
+  // Written under a temporary name and renamed, readers never see a partial index
+  std::ostringstream tmpPath;
+  tmpPath << m_indexPath << ".tmp" << getpid ();
+  std::ofstream file (tmpPath.str ().c_str (), std::ios::binary);
+  uint64_t magic = TIME_INDEX_MAGIC;
+  uint64_t firstSec = m_firstSec;
+  uint32_t firstFrac = m_firstFrac;
+  uint32_t numInterfaces = m_interfaces.size ();
+  uint32_t numEntries = m_index.size ();
+  file.write (reinterpret_cast<const char*> (&magic), sizeof (magic));
+  file.write (reinterpret_cast<const char*> (&m_size), sizeof (m_size));
+  file.write (reinterpret_cast<const char*> (&m_mtime), sizeof (m_mtime));
+  file.write (reinterpret_cast<const char*> (&firstSec), sizeof (firstSec));
+  file.write (reinterpret_cast<const char*> (&firstFrac), sizeof (firstFrac));
+  file.write (reinterpret_cast<const char*> (&numInterfaces), sizeof (numInterfaces));
+  file.write (reinterpret_cast<const char*> (&numEntries), sizeof (numEntries));
+  for (uint32_t i = 0; i < numInterfaces; i++)
+    {
+      uint32_t value[2] = { m_interfaces[i].linkType, m_interfaces[i].tsResolution };
+      file.write (reinterpret_cast<const char*> (value), sizeof (value));
+    }
+  if (numEntries > 0)
+    {
+      file.write (reinterpret_cast<const char*> (&m_index[0]), numEntries * sizeof (m_indexEntry));
+    }
+  file.close ();
+  // The index only speeds up later conversions, failures are not errors
+  if (!file || std::rename (tmpPath.str ().c_str (), m_indexPath.c_str ()) != 0)
+    {
+      NS_LOG_INFO ("Could not write time index " << m_indexPath);
+      std::remove (tmpPath.str ().c_str ());
+    }
+}
+
+void
+TraceReplayPcapReader::DecodeChunk (TraceReplayPcapChunk& chunk) const
+{
+  NS_LOG_FUNCTION (this);
+  std::map<TraceReplayPcapFlow, uint32_t> flowIndex;
+  TraceReplayPcapRecord record;
+  m_block block;
+  bool swapped = chunk.swapped;
+  uint64_t offset = chunk.offset;
+  uint32_t frameNum = chunk.firstFrame;
+  // Split has already validated the record boundaries and read the interfaces
+  while (offset < chunk.end)
+    {
+      const uint8_t* header = m_data + offset;
+      uint64_t length = BlockLength (header, swapped, frameNum);
+      offset += length;
+      ParseBlock (header, length, swapped, chunk.interfaceBase, frameNum, block);
+      if (!block.packet)
+        {
+          continue;
+        }
+
+      double time = RelativeTime (block.sec, block.frac);
+      if (block.capLen > 0 && m_filter.MatchesTime (time)
+          && DecodeFrame (m_interfaces[block.interface].linkType, block.frame, block.capLen, record, &m_filter))
+        {
+          TraceReplayPcapFlow flow;
+          flow.ipv6 = record.ipv6;
+          std::memcpy (flow.ipSrc, record.ipSrc, sizeof (flow.ipSrc));
+          std::memcpy (flow.ipDst, record.ipDst, sizeof (flow.ipDst));
+          flow.portSrc = record.portSrc;
+          flow.portDst = record.portDst;
+          std::map<TraceReplayPcapFlow, uint32_t>::iterator it = flowIndex.find (flow);
+          if (it == flowIndex.end ())
+            {
+              it = flowIndex.insert (std::make_pair (flow, (uint32_t) chunk.flows.size ())).first;
+              chunk.flows.push_back (flow);
+            }
+
+          TraceReplayPcapSegment segment;
+          segment.flow = it->second;
+          segment.frameNum = frameNum;
+          segment.seq = record.seq;
+          segment.ack = record.ack;
+          segment.flags = record.flags;
+          segment.httpRequest = record.httpRequest;
+          segment.payloadSize = record.payloadSize;
+          segment.time = time - m_filter.start;
+          chunk.segments.push_back (segment);
+        }
+      frameNum++;
+    }
+}
+
+void
+TraceReplayPcapReader::SetFilter (const TraceReplayPcapFilter& filter)
+{
+  NS_LOG_FUNCTION (this);
+  m_filter = filter;
+}
+
+bool
+TraceReplayPcapReader::IsSupportedLinkType (uint32_t linkType)
+{
+  return linkType == LINKTYPE_ETHERNET || linkType == LINKTYPE_RAW || linkType == LINKTYPE_LINUX_SLL
+    || linkType == LINKTYPE_LINUX_SLL2 || linkType == LINKTYPE_IEEE802_11 || linkType == LINKTYPE_IEEE802_11_RADIOTAP;
+}
+
+bool
+TraceReplayPcapReader::DecodeFrame (uint32_t linkType, const uint8_t* data, uint32_t length, TraceReplayPcapRecord& record,
+                                    const TraceReplayPcapFilter* filter)
+{
+  if (linkType == LINKTYPE_RAW)
+    {
+      return DecodeIp (data, length, record, filter);
+    }
+  if (linkType == LINKTYPE_ETHERNET)
+    {
+      if (length < 14)
+        {
+          return false;
+        }
+      return DecodeEtherType (ReadNetUint16 (data + 12), data + 14, length - 14, record, filter);
+    }
+  if (linkType == LINKTYPE_LINUX_SLL)
+    {
+      // Packet type, ARPHRD type, address length, address (8 bytes), protocol
+      if (length < 16)
+        {
+          return false;
+        }
+      return DecodeEtherType (ReadNetUint16 (data + 14), data + 16, length - 16, record, filter);
+    }
+  if (linkType == LINKTYPE_LINUX_SLL2)
+    {
+      // Protocol, reserved, interface index, ARPHRD type, packet type, address length, address (8 bytes)
+      if (length < 20)
+        {
+          return false;
+        }
+      return DecodeEtherType (ReadNetUint16 (data), data + 20, length - 20, record, filter);
+    }
+  if (linkType == LINKTYPE_IEEE802_11)
+    {
+      return DecodeWifi (data, length, false, record, filter);
+    }
+  if (linkType != LINKTYPE_IEEE802_11_RADIOTAP || length < 8 || data[0] != 0)
+    {
+      return false;
+    }
+
+  // Radiotap header is little endian: version, pad, length, present bitmaps
+  uint32_t headerLength = data[2] | (data[3] << 8);
+  if (headerLength < 8 || headerLength > length)
+    {
+      return false;
+    }
+  uint32_t present = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t) data[7] << 24);
+  uint32_t offset = 8;
+  uint32_t extended = present;
+  while ((extended & 0x80000000) && offset + 4 <= headerLength)
+    {
+      extended = data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | ((uint32_t) data[offset + 3] << 24);
+      offset += 4;
+    }
+  bool padded = false;
+  if (present & 0x02)
+    {
+      // Flags field, after the TSFT field (8 bytes, aligned to 8 bytes) if present
+      if (present & 0x01)
+        {
+          offset = ((offset + 7) & ~7) + 8;
+        }
+      if (offset >= headerLength)
+        {
+          return false;
+        }
+      uint8_t flags = data[offset];
+      if (flags & 0x40)
+        {
+          // Frame failed the FCS check
+          return false;
+        }
+      padded = (flags & 0x20) != 0;
+    }
+  return DecodeWifi (data + headerLength, length - headerLength, padded, record, filter);
+}
+
+bool
+TraceReplayPcapReader::DecodeEtherType (uint16_t etherType, const uint8_t* data, uint32_t length, TraceReplayPcapRecord& record,
+                                        const TraceReplayPcapFilter* filter)
+{
+  // Skip 802.1Q and 802.1ad vlan tags (tag control, EtherType of the payload)
+  uint32_t offset = 0;
+  while ((etherType == 0x8100 || etherType == 0x88a8 || etherType == 0x9100) && offset + 4 <= length)
+    {
+      etherType = ReadNetUint16 (data + offset + 2);
+      offset += 4;
+    }
+  if (etherType != 0x0800 && etherType != 0x86dd)
+    {
+      return false;
+    }
+  return DecodeIp (data + offset, length - offset, record, filter);
+}
+
+bool
+TraceReplayPcapReader::DecodeWifi (const uint8_t* data, uint32_t length, bool padded, TraceReplayPcapRecord& record,
+                                   const TraceReplayPcapFilter* filter)
+{
+  if (length < 24)
+    {
+      return false;
+    }
+  // Frame control is little endian: version, type, subtype, then the flags
+  uint8_t type = (data[0] >> 2) & 0x03;
+  uint8_t subtype = data[0] >> 4;
+  uint8_t flags = data[1];
+  if (type != 2 || (subtype & 0x04) || (flags & 0x40))
+    {
+      // Management or control frame, data frame without payload (null function), or protected frame
+      return false;
+    }
+
+  uint32_t offset = 24;
+  if ((flags & 0x03) == 0x03)
+    {
+      // Address 4 of frames between access points (mesh, WDS)
+      offset += 6;
+    }
+  if (subtype & 0x08)
+    {
+      if (offset + 2 > length)
+        {
+          return false;
+        }
+      if (data[offset] & 0x80)
+        {
+          // A-MSDU carries several packets in one frame, not decoded
+          return false;
+        }
+      offset += 2;
+      if (flags & 0x80)
+        {
+          // HT control field of QoS frames with the order flag
+          offset += 4;
+        }
+    }
+  if (padded)
+    {
+      offset = (offset + 3) & ~3;
+    }
+
+  // LLC/SNAP header: DSAP, SSAP, control, OUI (RFC 1042 or bridge tunnel), EtherType
+  if (offset + 8 > length || data[offset] != 0xaa || data[offset + 1] != 0xaa || data[offset + 2] != 0x03
+      || data[offset + 3] != 0 || data[offset + 4] != 0 || (data[offset + 5] != 0 && data[offset + 5] != 0xf8))
+    {
+      return false;
+    }
+  return DecodeEtherType (ReadNetUint16 (data + offset + 6), data + offset + 8, length - offset - 8, record, filter);
+}
+
+bool
+TraceReplayPcapReader::DecodeIp (const uint8_t* data, uint32_t length, TraceReplayPcapRecord& record,
+                                 const TraceReplayPcapFilter* filter)
+{
+  if (length < 1)
+    {
+      return false;
+    }
+
+  uint32_t offset = 0;      // offset of tcp header
+  uint32_t ipEnd = 0;       // offset where the ip payload ends
+  uint8_t version = data[0] >> 4;
+  if (version == 4)
+    {
+      if (length < 20)
+        {
+          return false;
+        }
+      uint32_t headerLength = (data[0] & 0x0f) * 4;
+      uint32_t totalLength = ReadNetUint16 (data + 2);
+      uint16_t fragment = ReadNetUint16 (data + 6);
+      if (headerLength < 20 || data[9] != 6 || (fragment & 0x3fff) != 0)
+        {
+          // Not tcp, or a fragment (tcp.len is not known for fragments)
+          return false;
+        }
+      if (totalLength == 0)
+        {
+          // Segmentation offload leaves total length as 0, use the captured length
+          totalLength = length;
+        }
+      if (totalLength < headerLength)
+        {
+          return false;
+        }
+      record.ipv6 = false;
+      std::memset (record.ipSrc, 0, sizeof (record.ipSrc));
+      std::memset (record.ipDst, 0, sizeof (record.ipDst));
+      std::memcpy (record.ipSrc, data + 12, 4);
+      std::memcpy (record.ipDst, data + 16, 4);
+      offset = headerLength;
+      ipEnd = totalLength;
+    }
+  else if (version == 6)
+    {
+      if (length < 40)
+        {
+          return false;
+        }
+      uint32_t payloadLength = ReadNetUint16 (data + 4);
+      if (payloadLength == 0)
+        {
+          // Jumbogram or segmentation offload, use the captured length
+          payloadLength = length - 40;
+        }
+      uint8_t nextHeader = data[6];
+      record.ipv6 = true;
+      std::memcpy (record.ipSrc, data + 8, 16);
+      std::memcpy (record.ipDst, data + 24, 16);
+      offset = 40;
+      ipEnd = 40 + payloadLength;
+      // Walk the extension headers till tcp header
+      while (nextHeader != 6)
+        {
+          if (offset + 8 > length)
+            {
+              return false;
+            }
+          uint32_t extLength;
+          if (nextHeader == 0 || nextHeader == 43 || nextHeader == 60)
+            {
+              // Hop-by-hop, routing and destination options
+              extLength = (data[offset + 1] + 1) * 8;
+            }
+          else if (nextHeader == 44)
+            {
+              // Fragment header, skip fragmented packets
+              if ((ReadNetUint16 (data + offset + 2) & 0xfff9) != 0)
+                {
+                  return false;
+                }
+              extLength = 8;
+            }
+          else if (nextHeader == 51)
+            {
+              // Authentication header
+              extLength = (data[offset + 1] + 2) * 4;
+            }
+          else
+            {
+              return false;
+            }
+          nextHeader = data[offset];
+          offset += extLength;
+        }
+    }
+  else
+    {
+      return false;
+    }
+
+  if (offset + 20 > length)
+    {
+      return false;
+    }
+  const uint8_t* tcp = data + offset;
+  uint32_t tcpHeaderLength = (tcp[12] >> 4) * 4;
+  if (tcpHeaderLength < 20 || offset + tcpHeaderLength > ipEnd)
+    {
+      return false;
+    }
+
+  record.portSrc = ReadNetUint16 (tcp);
+  record.portDst = ReadNetUint16 (tcp + 2);
+  if (filter != 0 && !filter->MatchesFlow (record.ipv6, record.ipSrc, record.ipDst, record.portSrc, record.portDst))
+    {
+      return false;
+    }
+  record.seq = ReadNetUint32 (tcp + 4);
+  record.ack = ReadNetUint32 (tcp + 8);
+  record.flags = tcp[13];
+  record.payloadSize = ipEnd - offset - tcpHeaderLength;
+  uint32_t payloadOffset = offset + tcpHeaderLength;
+  record.payload = data + payloadOffset;
+  record.capturedPayload = payloadOffset < length ? length - payloadOffset : 0;
+  if (record.capturedPayload > record.payloadSize)
+    {
+      // Ethernet padding is not a part of the payload
+      record.capturedPayload = record.payloadSize;
+    }
+  record.httpRequest = IsHttpRequest (record.payload, record.capturedPayload);
+  return true;
+}
+
+bool
+TraceReplayPcapReader::IsHttpMethod (const uint8_t* data, uint32_t length)
+{
+  // All the methods are in upper case letters
+  if (length < 4 || data[0] < 'C' || data[0] > 'U')
+    {
+      return false;
+    }
+  for (uint32_t i = 0; i < sizeof (HTTP_METHODS) / sizeof (HTTP_METHODS[0]); i++)
+    {
+      uint32_t methodLength = std::strlen (HTTP_METHODS[i]);
+      if (methodLength <= length && std::memcmp (data, HTTP_METHODS[i], methodLength) == 0)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+bool
+TraceReplayPcapReader::IsHttpRequest (const uint8_t* payload, uint32_t length)
+{
+  if (IsHttpMethod (payload, length))
+    {
+      return true;
+    }
+  // Pipelined request can start after the blank line ending the previous
+  // request's header. Binary payloads (tls, media) are not searched.
+  if (length == 0 || !((payload[0] >= 0x20 && payload[0] < 0x7f) || payload[0] == '\r' || payload[0] == '\n'))
+    {
+      return false;
+    }
+  const uint8_t* end = payload + length;
+  const uint8_t* p = payload;
+  while ((p = static_cast<const uint8_t*> (std::memchr (p, '\r', end - p))) != 0)
+    {
+      if (end - p >= 4 && p[1] == '\n' && p[2] == '\r' && p[3] == '\n'
+          && IsHttpMethod (p + 4, end - p - 4))
+        {
+          return true;
+        }
+      p++;
+    }
+  return false;
+}
+
+} // namespace ns3
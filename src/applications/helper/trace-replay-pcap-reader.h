@@ -0,0 +1,604 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ */
+
+#ifndef TRACE_REPLAY_PCAP_READER_H
+#define TRACE_REPLAY_PCAP_READER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * \brief Details of a single tcp segment decoded from the input pcap
+ *
+ * Fields mirror the ones TraceReplayHelper used to request from tshark
+ * (ip.src, tcp.srcport, ip.dst, tcp.dstport, tcp.len, frame.time_relative,
+ * frame.number, tcp.seq, tcp.ack and tcp.flags). Addresses are kept in network byte order; for IPv4
+ * only the first 4 bytes of ipSrc and ipDst are used.
+ */
+struct TraceReplayPcapRecord
+{
+  uint32_t        frameNum;         //!< Frame number of the packet in pcap (starting from 1)
+  double          time;             //!< Time relative to the first frame in pcap (seconds)
+  bool            ipv6;             //!< True if the segment was carried over IPv6
+  uint8_t         ipSrc[16];        //!< Source ip address
+  uint8_t         ipDst[16];        //!< Destination ip address
+  uint16_t        portSrc;          //!< Source port number
+  uint16_t        portDst;          //!< Destination port number
+  uint32_t        seq;              //!< Sequence number
+  uint32_t        ack;              //!< Acknowledgement number
+  uint8_t         flags;            //!< tcp flags (FIN = 0x01, SYN = 0x02, RST = 0x04, ACK = 0x10)
+  uint32_t        payloadSize;      //!< Size of the tcp payload (tcp.len)
+  const uint8_t*  payload;          //!< Captured bytes of the tcp payload
+  uint32_t        capturedPayload;  //!< Number of captured payload bytes (may be < payloadSize)
+  bool            httpRequest;      //!< True if a http request starts in the payload
+};
+
+/**
+ * \brief Selects the tcp segments converted by TraceReplayHelper
+ *
+ * A segment is kept if it goes from a client in the subnet to one of the
+ * server ports, or the other way round, and its time is in the window.
+ * An unset subnet or an empty port set matches every segment.
+ */
+struct TraceReplayPcapFilter
+{
+  TraceReplayPcapFilter ();
+
+  /**
+   * \brief Checks whether the filter keeps every segment
+   *
+   * \returns True if no subnet, port or time window is set
+   */
+  bool IsEmpty () const;
+
+  /**
+   * \brief Checks whether a time is in the window
+   *
+   * \param time Time relative to the first frame (seconds)
+   *
+   * \returns True if the time is in [start, end]
+   */
+  bool MatchesTime (double time) const;
+
+  /**
+   * \brief Checks the addresses and ports of a segment in either direction
+   *
+   * The direction of a single segment does not tell which endpoint is the client,
+   * so this only drops segments which can belong to no kept connection. The client
+   * role is checked by MatchesConnection once it is known.
+   *
+   * \param ipv6 True if the segment is over IPv6
+   * \param ipSrc Source ip address (16 bytes)
+   * \param ipDst Destination ip address (16 bytes)
+   * \param portSrc Source port number
+   * \param portDst Destination port number
+   *
+   * \returns True if either endpoint is in the subnet with the other one on a server port in the set
+   */
+  bool MatchesFlow (bool ipv6, const uint8_t* ipSrc, const uint8_t* ipDst, uint16_t portSrc, uint16_t portDst) const;
+
+  /**
+   * \brief Checks the client and server of a connection
+   *
+   * \param ipv6 True if the connection is over IPv6
+   * \param ipClient Client ip address (16 bytes)
+   * \param portServer Server port number
+   *
+   * \returns True if the client is in the subnet and the server port in the set
+   */
+  bool MatchesConnection (bool ipv6, const uint8_t* ipClient, uint16_t portServer) const;
+
+  /**
+   * \brief Checks whether the filter depends on the client role
+   *
+   * \returns True if a subnet or a server port is set
+   */
+  bool FiltersClients () const;
+
+  bool              subnet;         //!< True if the client subnet is set
+  bool              ipv6;           //!< True if the client subnet is an IPv6 prefix
+  uint8_t           network[16];    //!< Client network address
+  uint8_t           mask[16];       //!< Client network mask
+  std::vector<bool> serverPorts;    //!< Server ports to keep, indexed by port number (empty keeps all)
+  double            start;          //!< Start of the time window (seconds relative to the first frame)
+  double            end;            //!< End of the time window (seconds relative to the first frame)
+
+private:
+  /**
+   * \brief Checks whether an address is in the client subnet
+   *
+   * \param ip Ip address (16 bytes)
+   *
+   * \returns True if the address is in the subnet
+   */
+  bool IsClient (const uint8_t* ip) const;
+};
+
+/**
+ * \brief One direction of a tcp connection, as seen in a part of the pcap
+ */
+struct TraceReplayPcapFlow
+{
+  bool            ipv6;             //!< True if the flow is over IPv6
+  uint8_t         ipSrc[16];        //!< Source ip address
+  uint8_t         ipDst[16];        //!< Destination ip address
+  uint16_t        portSrc;          //!< Source port number
+  uint16_t        portDst;          //!< Destination port number
+  /**
+   * \brief < operator for TraceReplayPcapFlow.
+   */
+  bool operator< (const TraceReplayPcapFlow& rhs) const;
+};
+
+/**
+ * \brief A tcp segment decoded by a worker thread, without its payload
+ */
+struct TraceReplayPcapSegment
+{
+  uint32_t        flow;             //!< Index of the flow in TraceReplayPcapChunk::flows
+  uint32_t        frameNum;         //!< Frame number of the packet in pcap
+  uint32_t        seq;              //!< Sequence number
+  uint32_t        ack;              //!< Acknowledgement number
+  uint8_t         flags;            //!< tcp flags
+  uint32_t        payloadSize;      //!< Size of the tcp payload (tcp.len)
+  double          time;             //!< Time relative to the first frame in pcap (seconds)
+  bool            httpRequest;      //!< True if a http request starts in the payload
+};
+
+/**
+ * \brief A record-aligned part of the pcap and the segments decoded from it
+ *
+ * Each chunk builds its own partial flow table, so that the ip addresses of
+ * a flow are converted only once per chunk instead of once per packet.
+ * Segments are kept in frame order.
+ */
+struct TraceReplayPcapChunk
+{
+  uint64_t        offset;           //!< File offset of the first record in the chunk
+  uint64_t        end;              //!< File offset just after the last record in the chunk
+  uint32_t        firstFrame;       //!< Frame number of the first record in the chunk
+  bool            swapped;          //!< Byte order of the pcapng section the chunk is in
+  uint32_t        interfaceBase;    //!< Index of the section's first interface in the reader
+
+  std::vector<TraceReplayPcapFlow>      flows;      //!< Partial flow table for the chunk
+  std::vector<TraceReplayPcapSegment>   segments;   //!< Decoded tcp segments, in frame order
+};
+
+/**
+ * \brief TraceReplayPcapReader walks a pcap file once and decodes
+ * link layer, IPv4/IPv6 and TCP headers of each frame in-process.
+ *
+ * Link types understood are Ethernet, raw IP, Linux cooked capture (SLL
+ * and SLL2, as written for the "any" interface) and 802.11 with or
+ * without a radiotap header (monitor mode captures). Only 802.11 data
+ * frames are decoded, management, control and encrypted frames are
+ * dropped after reading their frame control field.
+ *
+ * Both classic (libpcap) and pcapng files are understood. Uncompressed
+ * files are memory-mapped and records are decoded in place, so no frame
+ * is copied and no memory is allocated per packet. Files compressed with
+ * gzip or zstd (and pipes) are streamed instead: the decompressor runs as
+ * a separate process and a reader thread keeps a few blocks of its output
+ * ready, so decompression overlaps decoding and nothing is written to the
+ * disk. Frames which do not carry a tcp segment are counted (to keep
+ * frame numbers in sync with tshark) but are not returned to the caller.
+ */
+class TraceReplayPcapReader
+{
+public:
+  TraceReplayPcapReader ();
+  ~TraceReplayPcapReader ();
+
+  /**
+   * \brief Opens the pcap file and reads its global header
+   *
+   * \param path Path to input pcap file
+   *
+   * \returns False if the file is not a pcap or pcapng with a supported link type
+   */
+  bool Open (std::string path);
+
+  /**
+   * \brief Reads frames until the next tcp segment is found
+   *
+   * Payload pointer in the record points into the mapped file, or into
+   * the stream buffer, and is valid till the next call.
+   *
+   * \param record Record to fill with the details of the segment
+   *
+   * \returns False if there are no more tcp segments in the file
+   */
+  bool ReadNext (TraceReplayPcapRecord& record);
+
+  /**
+   * \brief Unmaps the pcap file, or stops the stream and its decompressor
+   *
+   * Exits if the decompressor failed on a stream which was read till its end.
+   */
+  void Close ();
+
+  /**
+   * \brief Checks whether the records can be split into chunks
+   *
+   * \returns True if the file is memory-mapped (not compressed or streamed)
+   */
+  bool CanSplit () const;
+
+  /**
+   * \brief Uses a sparse time index of the pcap, stored in a sidecar file
+   *
+   * Must be called after Open and SetFilter, before any record is read.
+   * If the sidecar matches the pcap (same size and modification time), reading
+   * starts close to the start of the filter's time window and stops soon after
+   * its end, so only that part of the file is read. Otherwise the index is
+   * built while the whole file is read and written to the sidecar at the end.
+   * Only memory-mapped files are indexed. Timestamps are expected to go back
+   * by less than the index interval (10 seconds).
+   *
+   * \param path Path of the sidecar file
+   */
+  void UseTimeIndex (std::string path);
+
+  /**
+   * \brief Sets the time to which the times of the records are relative
+   *
+   * Must be called after Open, before any record is read. By default
+   * times are relative to the first frame of the pcap. Used to keep the
+   * times of a later segment of a rolling capture relative to the first
+   * frame of the first segment.
+   *
+   * \param sec Seconds part of the absolute time
+   * \param nsec Nanoseconds part of the absolute time
+   */
+  void SetTimeOrigin (uint64_t sec, uint32_t nsec);
+
+  /**
+   * \brief Gets the time to which the times of the records are relative
+   *
+   * \param sec Set to the seconds part of the absolute time
+   * \param nsec Set to the nanoseconds part of the absolute time
+   *
+   * \returns False if no frame has been read and no origin was set
+   */
+  bool GetTimeOrigin (uint64_t& sec, uint32_t& nsec) const;
+
+  /**
+   * \brief Splits the records of the pcap into chunks of roughly equal size
+   *
+   * Only the record headers are read. Records already returned by
+   * ReadNext are not included in any chunk. Chunks of a pcapng file
+   * never span a section header. Only a mapped file can be split.
+   *
+   * \param numChunks Number of chunks to create
+   * \param chunks Vector to fill with the chunk boundaries
+   */
+  void Split (uint32_t numChunks, std::vector<TraceReplayPcapChunk>& chunks);
+
+  /**
+   * \brief Decodes all the tcp segments of a chunk created by Split
+   *
+   * The reader is not modified, so different chunks can be decoded by
+   * different threads at the same time.
+   *
+   * \param chunk Chunk to decode
+   */
+  void DecodeChunk (TraceReplayPcapChunk& chunk) const;
+
+  /**
+   * \brief Decodes the link, network and transport headers of a frame
+   *
+   * \param linkType Link type of the frame (as in pcap global header)
+   * \param data Captured bytes of the frame
+   * \param length Number of captured bytes
+   * \param record Record to fill with ip, port and payload details
+   * \param filter Filter checked as soon as the ports are decoded, or 0
+   *
+   * \returns True if the frame carries a tcp segment kept by the filter
+   */
+  static bool DecodeFrame (uint32_t linkType, const uint8_t* data, uint32_t length, TraceReplayPcapRecord& record,
+                           const TraceReplayPcapFilter* filter = 0);
+
+  /**
+   * \brief Sets the filter of the segments returned by ReadNext and DecodeChunk
+   *
+   * Segments outside the filter are dropped right after their headers are
+   * decoded (their payload is not searched for http requests). Frame numbers
+   * still count every frame. Times of the returned segments are relative to
+   * the start of the time window.
+   *
+   * \param filter Filter to apply
+   */
+  void SetFilter (const TraceReplayPcapFilter& filter);
+
+private:
+  /**
+   * \brief Link type and timestamp resolution of a capture interface
+   */
+  struct m_interface
+  {
+    uint32_t        linkType;         //!< Link type of the frames
+    uint8_t         tsResolution;     //!< if_tsresol option of pcapng (6 means microseconds)
+  };
+
+  /**
+   * \brief A record of classic pcap or a block of pcapng, as decoded by ParseBlock
+   */
+  struct m_block
+  {
+    uint32_t        type;             //!< pcapng block type (packet blocks for classic records)
+    bool            packet;           //!< True if the block carries a frame
+    uint32_t        interface;        //!< Index of the frame's interface in m_interfaces
+    uint64_t        sec;              //!< Seconds part of the timestamp
+    uint32_t        frac;             //!< Fractional part of the timestamp
+    uint32_t        capLen;           //!< Number of captured bytes of the frame
+    const uint8_t*  frame;            //!< Captured bytes of the frame
+  };
+
+  /**
+   * \brief Position in the pcap of the first frame at or after a time, as stored in the time index
+   */
+  struct m_indexEntry
+  {
+    double          time;             //!< Time of the frame relative to the first frame
+    uint64_t        offset;           //!< File offset of the frame's record or block
+    uint32_t        frameNum;         //!< Number of frames before it
+    uint32_t        numInterfaces;    //!< Number of interfaces described before it
+    uint32_t        interfaceBase;    //!< Index of its section's first interface
+    uint32_t        swapped;          //!< Byte order of its section
+  };
+
+  /**
+   * \brief Reads the time index sidecar
+   *
+   * \returns False if the sidecar is missing or does not match the pcap
+   */
+  bool LoadTimeIndex ();
+
+  /**
+   * \brief Writes the time index built while reading the whole file
+   */
+  void SaveTimeIndex ();
+
+  /**
+   * \brief Records a frame in the time index if it starts a new interval
+   *
+   * \param offset File offset of the frame's record or block
+   * \param frameNum Number of frames before it
+   * \param time Time of the frame relative to the first frame
+   */
+  void IndexFrame (uint64_t offset, uint32_t frameNum, double time);
+
+  /**
+   * \brief Reads the file header, and for pcapng the interfaces described before the first packet
+   *
+   * \returns False if the format or a link type is not supported
+   */
+  bool ReadFileHeader ();
+
+  /**
+   * \brief Starts the decompressor (or reads a pipe) and the reader thread
+   *
+   * \param command Shell command printing the pcap, or empty to read fd
+   * \param fd Descriptor of the opened file
+   *
+   * \returns False if the decompressor could not be started
+   */
+  bool OpenStream (std::string command, int fd);
+
+  /**
+   * \brief Body of the reader thread, reads blocks of the stream into m_blocks
+   */
+  void ReadStream ();
+
+  /**
+   * \brief Makes the next bytes of the file available in contiguous memory
+   *
+   * \param length Number of bytes needed
+   *
+   * \returns Pointer to the bytes, or 0 if fewer bytes are left in the file
+   */
+  const uint8_t* Peek (uint64_t length);
+
+  /**
+   * \brief Moves past the bytes returned by Peek
+   *
+   * \param length Number of bytes to move past
+   */
+  void Consume (uint64_t length);
+
+  /**
+   * \brief Size of the part of a record or block which holds its length
+   *
+   * \returns 16 for classic pcap records, 12 for pcapng blocks
+   */
+  uint32_t HeaderSize () const;
+
+  /**
+   * \brief Computes the total length of a record or block, exits if it is corrupted
+   *
+   * \param header First HeaderSize () bytes of the record
+   * \param swapped Byte order of the current section, updated by a section header block
+   * \param frameNum Number of the next frame, for error messages
+   *
+   * \returns Length of the record including its header
+   */
+  uint64_t BlockLength (const uint8_t* header, bool& swapped, uint32_t frameNum) const;
+
+  /**
+   * \brief Decodes the fields of a complete record or block
+   *
+   * \param data Start of the record
+   * \param length Length returned by BlockLength
+   * \param swapped Byte order of the current section
+   * \param interfaceBase Index of the current section's first interface
+   * \param frameNum Number of the next frame, for error messages
+   * \param block Block to fill
+   */
+  void ParseBlock (const uint8_t* data, uint64_t length, bool swapped, uint32_t interfaceBase,
+                   uint32_t frameNum, m_block& block) const;
+
+  /**
+   * \brief Reports, the first time only, that simple packet blocks are skipped
+   */
+  void WarnSimplePacket (void);
+
+  /**
+   * \brief Adds the interface described by a pcapng interface description block
+   *
+   * \param data Start of the block
+   * \param length Length of the block
+   * \param swapped Byte order of the current section
+   */
+  void AddInterface (const uint8_t* data, uint64_t length, bool swapped);
+
+  /**
+   * \brief Checks whether DecodeFrame understands a link type
+   *
+   * \param linkType Link type (as in pcap global header)
+   *
+   * \returns True if the link type is supported
+   */
+  static bool IsSupportedLinkType (uint32_t linkType);
+
+  /**
+   * \brief Skips vlan tags and decodes the ip packet following an EtherType
+   *
+   * \param etherType EtherType of the payload
+   * \param data Captured bytes following the EtherType
+   * \param length Number of captured bytes
+   * \param record Record to fill
+   * \param filter Filter to check, or 0
+   *
+   * \returns True if the packet carries a tcp segment kept by the filter
+   */
+  static bool DecodeEtherType (uint16_t etherType, const uint8_t* data, uint32_t length, TraceReplayPcapRecord& record,
+                               const TraceReplayPcapFilter* filter);
+
+  /**
+   * \brief Decodes an 802.11 data frame and its LLC/SNAP header
+   *
+   * \param data Captured bytes starting from the frame control field
+   * \param length Number of captured bytes
+   * \param padded True if the radiotap header says the 802.11 header is padded to 32 bits
+   * \param record Record to fill
+   * \param filter Filter to check, or 0
+   *
+   * \returns True if the frame carries a tcp segment kept by the filter
+   */
+  static bool DecodeWifi (const uint8_t* data, uint32_t length, bool padded, TraceReplayPcapRecord& record,
+                          const TraceReplayPcapFilter* filter);
+
+  /**
+   * \brief Decodes IPv4/IPv6 and tcp headers
+   *
+   * \param data Captured bytes starting from the ip header
+   * \param length Number of captured bytes
+   * \param record Record to fill
+   * \param filter Filter to check, or 0
+   *
+   * \returns True if the packet carries a tcp segment kept by the filter
+   */
+  static bool DecodeIp (const uint8_t* data, uint32_t length, TraceReplayPcapRecord& record,
+                        const TraceReplayPcapFilter* filter);
+
+  /**
+   * \brief Checks whether a http request starts in the tcp payload
+   *
+   * A request starts with a method token (like "GET ") at the beginning
+   * of the payload, or right after the end of the previous request's
+   * header for pipelined requests. Only text payloads are searched for
+   * pipelined requests, so binary payloads cost a few byte compares.
+   *
+   * \param payload Captured bytes of the tcp payload
+   * \param length Number of captured bytes
+   *
+   * \returns True if a http request starts in the payload
+   */
+  static bool IsHttpRequest (const uint8_t* payload, uint32_t length);
+
+  /**
+   * \brief Checks whether the data starts with a http method token followed by a space
+   *
+   * \param data Bytes to check
+   * \param length Number of bytes available
+   *
+   * \returns True if data starts with a http method
+   */
+  static bool IsHttpMethod (const uint8_t* data, uint32_t length);
+
+  /**
+   * \brief Computes the time of a frame relative to the first frame
+   *
+   * \param sec Seconds part of the timestamp
+   * \param frac Fractional part of the timestamp
+   *
+   * \returns Relative time in seconds
+   */
+  double RelativeTime (uint64_t sec, uint32_t frac) const;
+
+  std::string           m_path;         //!< Path to input pcap file
+  const uint8_t*        m_data;         //!< Start of the mapped pcap file
+  uint64_t              m_size;         //!< Size of the mapped pcap file
+  uint64_t              m_offset;       //!< Offset of the next record to read
+  bool                  m_pcapng;       //!< True if the file is in pcapng format
+  bool                  m_swapped;      //!< True if pcap (or current pcapng section) has the other byte order
+  bool                  m_nanosecond;   //!< True if timestamps have nanosecond resolution
+  std::vector<m_interface> m_interfaces; //!< Interfaces of all the sections (a single one for classic pcap)
+  uint32_t              m_interfaceBase; //!< Index of the current section's first interface
+  uint32_t              m_frameNum;     //!< Number of frames read so far
+  bool                  m_firstFrame;   //!< True till the first frame is read
+  bool                  m_simpleWarned; //!< True once simple packet blocks were reported as not decoded
+  uint64_t              m_firstSec;     //!< Seconds part of the first frame's timestamp
+  uint32_t              m_firstFrac;    //!< Fractional part of the first frame's timestamp
+  TraceReplayPcapFilter m_filter;       //!< Segments to return
+  uint64_t              m_stopOffset;   //!< Offset where reading stops (end of the time window)
+  int64_t               m_mtime;        //!< Modification time of the mapped file (nanoseconds)
+
+  std::string           m_indexPath;    //!< Path of the time index sidecar, empty if not used
+  bool                  m_indexBuild;   //!< True if the time index is built while reading
+  double                m_nextIndexTime; //!< Time of the next interval of the time index
+  std::vector<m_indexEntry> m_index;    //!< Entries of the time index, in file order
+  std::vector<m_interface> m_indexInterfaces; //!< All the interfaces of the file, as stored in the time index
+
+  FILE*                 m_stream;       //!< Decompressor output or pipe, 0 if the file is mapped
+  bool                  m_process;      //!< True if m_stream was opened by popen
+  std::thread           m_streamThread; //!< Reader thread filling m_blocks
+  std::mutex            m_streamMutex;  //!< Protects m_blocks, m_streamEnd and m_streamStop
+  std::condition_variable m_streamCond; //!< Signals a block read or consumed
+  std::deque<std::vector<uint8_t> > m_blocks; //!< Blocks read ahead by the reader thread
+  bool                  m_streamEnd;    //!< True once the reader thread reached the end of the stream
+  bool                  m_streamStop;   //!< True when the reader thread must stop early
+  bool                  m_streamDrained; //!< True once all the blocks were consumed
+  std::vector<uint8_t>  m_buffer;       //!< Bytes of the stream being decoded
+  uint64_t              m_bufferPos;    //!< Position of the next record in m_buffer
+};
+
+} // namespace ns3
+#endif /* TRACE_REPLAY_PCAP_READER_H */
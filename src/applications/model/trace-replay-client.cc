@@ -38,12 +38,16 @@
 #include "ns3/string.h"
 #include "ns3/pointer.h"
 #include "ns3/trace-replay-utility.h"
+#include "ns3/trace-replay-trace.h"
 #include "trace-replay-client.h"
 
 namespace ns3 {
 NS_LOG_COMPONENT_DEFINE ("TraceReplayClient");
 NS_OBJECT_ENSURE_REGISTERED (TraceReplayClient);
 
+// Number of packets of the connection read ahead from the trace at a time
+static const uint32_t PACKET_WINDOW = 4096;
+
 TypeId TraceReplayClient::GetTypeId (void)
 {
   static TypeId tid = TypeId ("ns3::TraceReplayClient")
@@ -62,7 +66,16 @@ TraceReplayClient::TraceReplayClient ()
     m_connected (false),
     m_totRecByte (0),
     m_totExpByte (0),
-    m_totByteCount (0)
+    m_totByteCount (0),
+    m_trace (0),
+    m_connection (0),
+    m_numReqIndex (0),
+    m_numReqLeft (0),
+    m_expByteIndex (0),
+    m_packetIndex (0),
+    m_windowStart (0),
+    m_windowEnd (0),
+    m_replaying (false)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -70,10 +83,8 @@ TraceReplayClient::TraceReplayClient ()
 TraceReplayClient::~TraceReplayClient ()
 {
   NS_LOG_FUNCTION (this);
-  m_numReq.clear ();
-  m_expByte.clear ();
-  m_packetList.clear ();
   m_parallelConnList.clear ();
+  m_trace = 0;
   m_socket = 0;
 }
 
@@ -101,6 +112,7 @@ void
 TraceReplayClient::StopApplication (void)
 {
   NS_LOG_FUNCTION (this);
+  ReleaseConnection ();
   m_connected = false;
   if (m_sendEvent.IsRunning ())
     {
@@ -191,31 +203,94 @@ TraceReplayClient::SetConnectionId (Address ipClient, uint16_t portClient, Addre
 
 void
 TraceReplayClient::Setup (Address address, DataRate dataRate, std::vector<uint32_t> numReq, std::vector<uint32_t> expByte, std::vector<TraceReplayPacket> packetList)
+{
+  NS_LOG_FUNCTION (this);
+  // Packets are stored as the only connection of a trace, the server side is empty
+  uint8_t ip[16] = { 0 };
+  std::vector<TraceReplayPacket> noPackets;
+  std::vector<uint32_t> noCounts;
+  std::string image;
+  TraceReplayTrace::WriteHeader (image, 1, packetList.size ());
+  TraceReplayTrace::WriteConnection (image, ip, 0, ip, 0, false, Seconds (0), packetList, numReq, expByte,
+                                     noPackets, noCounts, noCounts);
+  Setup (address, dataRate, Create<TraceReplayTrace> ("TraceReplayClient", image), 0);
+}
+
+void
+TraceReplayClient::Setup (Address address, DataRate dataRate, Ptr<const TraceReplayTrace> trace, uint32_t connection)
 {
   NS_LOG_FUNCTION (this);
   m_peer = address;
   m_dataRate = dataRate;
+  ReleaseConnection ();
+  m_trace = trace;
+  m_connection = connection;
+  m_trace->Acquire (m_connection, TraceReplayTrace::CLIENT);
+  m_replaying = true;
+
+  // If the conneciton does not have any packet then there is no request.
+  // GetNumReq returns 0 to indicate client that it does not have to send any packet
+  m_numReqIndex = 0;
+  m_numReqLeft = GetNumReq (0);
+  m_expByteIndex = 0;
+  m_packetIndex = 0;
+  m_windowStart = 0;
+  m_windowEnd = 0;
+}
+
+uint32_t
+TraceReplayClient::GetNumReq (uint32_t index) const
+{
+  if (index < m_trace->GetNSendCounts (m_connection, TraceReplayTrace::CLIENT))
+    {
+      return m_trace->GetSendCount (m_connection, TraceReplayTrace::CLIENT, index);
+    }
+  return 0;
+}
 
-  // If the conneciton does not have any packet then numReq will be empty.
-  // Insert 0 to indicate client that it does not have to send any packet
-  m_numReq = numReq;
-  if (m_numReq.empty ())
+uint32_t
+TraceReplayClient::GetNextExpByte (void)
+{
+  // If the conneciton does not have any reply then 0 bytes are expected
+  uint32_t expByte = 0;
+  if (m_expByteIndex < m_trace->GetNReceiveCounts (m_connection, TraceReplayTrace::CLIENT))
     {
-      m_numReq.push_back (0);
+      expByte = m_trace->GetReceiveCount (m_connection, TraceReplayTrace::CLIENT, m_expByteIndex);
     }
-  m_numReqIt = m_numReq.begin ();
+  m_expByteIndex++;
+  return expByte;
+}
 
-  // If the conneciton does not have any packet then expByte will be empty.
-  // Insert 0 to indicate client that it does not have to receive any packet
-  m_expByte = expByte;
-  if (m_expByte.empty ())
+TraceReplayPacket
+TraceReplayClient::GetNextPacket (void)
+{
+  if (m_packetIndex >= m_windowEnd)
+    {
+      // Packets before the window are not read again, their pages are released
+      m_trace->MoveWindow (m_connection, TraceReplayTrace::CLIENT, m_windowStart, m_packetIndex, PACKET_WINDOW);
+      m_windowStart = m_packetIndex;
+      m_windowEnd = m_packetIndex + PACKET_WINDOW;
+    }
+  TraceReplayPacket packet = m_trace->GetPacket (m_connection, TraceReplayTrace::CLIENT, m_packetIndex++);
+  if (m_packetIndex == m_trace->GetNPackets (m_connection, TraceReplayTrace::CLIENT))
     {
-      m_expByte.push_back (0);
+      // Last packet read, pages of the packets of this side are not needed any more
+      m_trace->MoveWindow (m_connection, TraceReplayTrace::CLIENT, m_windowStart, m_packetIndex, 0);
+      m_windowStart = m_packetIndex;
     }
-  m_expByteIt = m_expByte.begin ();
+  return packet;
+}
 
-  m_packetList = packetList;
-  m_packetListIt = m_packetList.begin ();
+void
+TraceReplayClient::ReleaseConnection (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_replaying)
+    {
+      // Pages of the connection are released once its client and server are both done
+      m_trace->Release (m_connection, TraceReplayTrace::CLIENT);
+      m_replaying = false;
+    }
 }
 
 void
@@ -264,7 +339,7 @@ TraceReplayClient::SendPacket (TraceReplayPacket packet)
 
   // Update the total byte count for this connection
   m_totByteCount += packet.GetSize ();
-  if (*m_numReqIt > 0)
+  if (m_numReqLeft > 0)
     {
       // more packets are in send queue, schedule next packet
       ScheduleTx ();
@@ -272,13 +347,14 @@ TraceReplayClient::SendPacket (TraceReplayPacket packet)
   else
     {
       // update expected number of total bytes to be received
-      m_totExpByte = *(m_expByteIt++);
+      m_totExpByte = GetNextExpByte ();
       m_totRecByte = 0;
       // No more packets to receive. Close connection
       if (m_totExpByte == 0)
         {
           m_socket->Close ();
           m_connected = false;
+          ReleaseConnection ();
           return;
         }
       // go to receive mode
@@ -290,12 +366,12 @@ void
 TraceReplayClient::ScheduleTx (void)
 {
   NS_LOG_FUNCTION (this);
-  if (m_connected && *m_numReqIt > 0)
+  if (m_connected && m_numReqLeft > 0)
     {
       // Decrement number of packets to be send
-      *m_numReqIt -= 1;
+      m_numReqLeft -= 1;
 
-      TraceReplayPacket packet = *(m_packetListIt++);
+      TraceReplayPacket packet = GetNextPacket ();
       if ((packet.GetDelay ()).IsStrictlyPositive ())
         {
           // schedule packet after 'delay'
@@ -309,16 +385,17 @@ TraceReplayClient::ScheduleTx (void)
           return;
         }
     }
-  else if (*m_numReqIt == 0)
+  else if (m_numReqLeft == 0)
     {
       // No more packet to send, update expected number total bytes to be received
-      m_totExpByte = *(m_expByteIt++);
+      m_totExpByte = GetNextExpByte ();
       m_totRecByte = 0;
       if (m_totExpByte == 0)
         {
           // No more packet to send or receive
           m_socket->Close ();
           m_connected = false;
+          ReleaseConnection ();
         }
       else
         {
@@ -350,9 +427,10 @@ TraceReplayClient::ReceivePacket (Ptr<Socket> socket)
       // keep receiving packet
       m_socket->SetRecvCallback (MakeCallback (&TraceReplayClient::ReceivePacket, this));
     }
-  else if (m_numReqIt != m_numReq.end () && ++m_numReqIt != m_numReq.end ())
+  else if (m_numReqIndex + 1 < m_trace->GetNSendCounts (m_connection, TraceReplayTrace::CLIENT))
     {
       // go to send mode
+      m_numReqLeft = GetNumReq (++m_numReqIndex);
       ScheduleTx ();
     }
   else
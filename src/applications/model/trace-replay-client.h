@@ -37,6 +37,7 @@ namespace ns3 {
 class Address;
 class Socket;
 class TraceReplayPacket;
+class TraceReplayTrace;
 
 /**
  * \ingroup applications
@@ -45,8 +46,10 @@ class TraceReplayPacket;
  *
  * TraceReplayClient acts as a tcp client, which initializes connection to
  * TraceReplayServer and communicates with it in a request-reply mode.
- * In each cycle, it sends *m_numReq number of packets, from m_packetList,
- * as request and waits for server to send *m_expByte as reply.
+ * In each cycle, it sends the number of packets of the request, from the
+ * client side of its connection in m_trace, and waits for server to send
+ * the number of bytes of the reply. Packets and counts are read from
+ * m_trace when they are needed.
  * Before sending a packet, if the delay for the packet > 0 seconds,
  * it also checks the progress of all parallel connections
  * between same client IP and server IP.
@@ -91,6 +94,16 @@ public:
    */
   void Setup (Address address, DataRate dataRate, std::vector<uint32_t> numReq, std::vector<uint32_t> expByte, std::vector<TraceReplayPacket> packetList);
 
+  /**
+   * \brief This method initializes the client object with a connection of a trace.
+   *
+   * \param address peer address
+   * \param dataRate The datarate of the sever
+   * \param trace Trace containing the connection
+   * \param connection Index of the connection in the trace
+   */
+  void Setup (Address address, DataRate dataRate, Ptr<const TraceReplayTrace> trace, uint32_t connection);
+
   /**
    * \brief Returns real Ip address of server in the original connection
    *
@@ -176,6 +189,34 @@ private:
    */
   void ReceivePacket (Ptr<Socket> socket);
 
+  /**
+   * \brief Returns the number of packets to send in a request
+   *
+   * \param index Index of the request
+   *
+   * \returns Number of packets, 0 if there is no such request
+   */
+  uint32_t GetNumReq (uint32_t index) const;
+
+  /**
+   * \brief Returns the number of bytes to receive as the next reply
+   *
+   * \returns Number of bytes, 0 if there are no more replies
+   */
+  uint32_t GetNextExpByte (void);
+
+  /**
+   * \brief Reads the next packet to send, moving the window of packets read ahead when it is reached
+   *
+   * \returns Next packet to send
+   */
+  TraceReplayPacket GetNextPacket (void);
+
+  /**
+   * \brief Tells the trace that this application does not replay its connection any more
+   */
+  void ReleaseConnection (void);
+
   Ptr<Socket>     m_socket;       //!< Associated socket
   Address         m_peer;         //!< Peer address
   DataRate        m_dataRate;     //!< Data rate
@@ -189,13 +230,16 @@ private:
   uint32_t        m_totExpByte;   //!< Total number of bytes expected to receive
   uint32_t        m_totByteCount; //!< Total number of bytes seen in connection (sent + received)
 
-  std::vector<uint32_t>             m_numReq;       //!< List of #packets to send as requests
-  std::vector<uint32_t>             m_expByte;      //!< List of total bytes expected to receive for each set of request
-  std::vector<TraceReplayPacket>    m_packetList;   //!< List of packets
+  Ptr<const TraceReplayTrace> m_trace; //!< Trace containing the packets and counts of the connection
+  uint32_t        m_connection;   //!< Index of the connection in m_trace
+  uint32_t        m_numReqIndex;  //!< Index of the current request
+  uint32_t        m_numReqLeft;   //!< Number of packets still to send in the current request
+  uint32_t        m_expByteIndex; //!< Index of the next reply
+  uint32_t        m_packetIndex;  //!< Index of the next packet to send
+  uint32_t        m_windowStart;  //!< Index of the first packet of the window read ahead
+  uint32_t        m_windowEnd;    //!< Index after the last packet of the window read ahead
+  bool            m_replaying;    //!< True from Setup until the connection is released in m_trace
 
-  std::vector<uint32_t>::iterator             m_numReqIt;        //!< m_numReq iterator
-  std::vector<uint32_t>::iterator             m_expByteIt;       //!< m_expByte iterator
-  std::vector<TraceReplayPacket>::iterator    m_packetListIt;    //!< m_packetList iterator
   std::vector<Ptr<TraceReplayClient> >        m_parallelConnList; //!< List of all parallel connections
 };
 } // namespace ns3
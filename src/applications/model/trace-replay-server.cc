@@ -38,12 +38,16 @@
 #include "ns3/string.h"
 #include "ns3/pointer.h"
 #include "ns3/trace-replay-utility.h"
+#include "ns3/trace-replay-trace.h"
 #include "trace-replay-server.h"
 
 namespace ns3 {
 NS_LOG_COMPONENT_DEFINE ("TraceReplayServer");
 NS_OBJECT_ENSURE_REGISTERED (TraceReplayServer);
 
+// Number of packets of the connection read ahead from the trace at a time
+static const uint32_t PACKET_WINDOW = 4096;
+
 TypeId TraceReplayServer::GetTypeId (void)
 {
   static TypeId tid = TypeId ("ns3::TraceReplayServer")
@@ -62,15 +66,22 @@ TraceReplayServer::TraceReplayServer ()
   m_totRecByte = 0;
   m_totExpByte = 0;
   m_totByteCount = 0;
+  m_trace = 0;
+  m_connection = 0;
+  m_numRepIndex = 0;
+  m_numRepLeft = 0;
+  m_expByteIndex = 0;
+  m_packetIndex = 0;
+  m_windowStart = 0;
+  m_windowEnd = 0;
+  m_replaying = false;
 }
 
 TraceReplayServer::~TraceReplayServer ()
 {
   NS_LOG_FUNCTION (this);
-  m_numRep.clear ();
-  m_expByte.clear ();
-  m_packetList.clear ();
   m_parallelConnList.clear ();
+  m_trace = 0;
   m_socket = 0;
 }
 
@@ -97,6 +108,13 @@ void
 TraceReplayServer::StopApplication ()
 {
   NS_LOG_FUNCTION (this);
+  if (m_replaying)
+    {
+      // Packets still in the window are not sent any more
+      m_trace->MoveWindow (m_connection, TraceReplayTrace::SERVER, m_windowStart, m_windowEnd, 0);
+      m_windowStart = m_windowEnd;
+    }
+  ReleaseConnection ();
 
   m_connected = false;
 
@@ -127,6 +145,8 @@ void TraceReplayServer::HandleAccept (Ptr<Socket> socket, const Address& from)
 void TraceReplayServer::HandleSuccessClose (Ptr<Socket> socket)
 {
   NS_LOG_FUNCTION (this);
+  // Client has closed the connection, nothing more is sent
+  ReleaseConnection ();
   socket->Close ();
   socket->SetRecvCallback (MakeNullCallback<void, Ptr<Socket> > () );
   socket->SetCloseCallbacks (MakeNullCallback<void, Ptr<Socket> > (),
@@ -200,33 +220,96 @@ TraceReplayServer::SetConnectionId (Address ipClient, uint16_t portClient, Addre
 
 void
 TraceReplayServer::Setup (Address address, DataRate dataRate, std::vector<uint32_t> numRep, std::vector<uint32_t> expByte, std::vector<TraceReplayPacket> packetList)
+{
+  NS_LOG_FUNCTION (this);
+  // Packets are stored as the only connection of a trace, the client side is empty
+  uint8_t ip[16] = { 0 };
+  std::vector<TraceReplayPacket> noPackets;
+  std::vector<uint32_t> noCounts;
+  std::string image;
+  TraceReplayTrace::WriteHeader (image, 1, packetList.size ());
+  TraceReplayTrace::WriteConnection (image, ip, 0, ip, 0, false, Seconds (0), noPackets, noCounts, noCounts,
+                                     packetList, numRep, expByte);
+  Setup (address, dataRate, Create<TraceReplayTrace> ("TraceReplayServer", image), 0);
+}
+
+void
+TraceReplayServer::Setup (Address address, DataRate dataRate, Ptr<const TraceReplayTrace> trace, uint32_t connection)
 {
   NS_LOG_FUNCTION (this);
   m_local = address;
   m_dataRate = dataRate;
+  ReleaseConnection ();
+  m_trace = trace;
+  m_connection = connection;
+  m_trace->Acquire (m_connection, TraceReplayTrace::SERVER);
+  m_replaying = true;
+
+  // If the conneciton does not have any packet then there is no reply.
+  // GetNumRep returns 0 to indicate server that it does not have to send any packet
+  m_numRepIndex = 0;
+  m_numRepLeft = GetNumRep (0);
+  m_expByteIndex = 0;
+  m_packetIndex = 0;
+  m_windowStart = 0;
+  m_windowEnd = 0;
+  // Update m_totExpByte, as server will start in receive mode
+  m_totExpByte = GetNextExpByte ();
+}
 
-  // If the conneciton does not have any packet then numRep will be empty.
-  // Insert 0 to indicate server that it does not have to send any packet
-  m_numRep = numRep;
-  if (m_numRep.empty ())
+uint32_t
+TraceReplayServer::GetNumRep (uint32_t index) const
+{
+  if (index < m_trace->GetNSendCounts (m_connection, TraceReplayTrace::SERVER))
     {
-      m_numRep.push_back (0);
+      return m_trace->GetSendCount (m_connection, TraceReplayTrace::SERVER, index);
     }
-  m_numRepIt = m_numRep.begin ();
+  return 0;
+}
 
-  // If the conneciton does not have any packet then expByte will be empty.
-  // Insert 0 to indicate server that it does not have to receive any packet
-  m_expByte = expByte;
-  if (m_expByte.empty ())
+uint32_t
+TraceReplayServer::GetNextExpByte (void)
+{
+  // If the conneciton does not have any request then 0 bytes are expected
+  uint32_t expByte = 0;
+  if (m_expByteIndex < m_trace->GetNReceiveCounts (m_connection, TraceReplayTrace::SERVER))
     {
-      m_expByte.push_back (0);
+      expByte = m_trace->GetReceiveCount (m_connection, TraceReplayTrace::SERVER, m_expByteIndex);
     }
-  m_expByteIt = m_expByte.begin ();
-  // Update m_totExpByte, as server will start in receive mode
-  m_totExpByte = *(m_expByteIt++);
+  m_expByteIndex++;
+  return expByte;
+}
+
+TraceReplayPacket
+TraceReplayServer::GetNextPacket (void)
+{
+  if (m_packetIndex >= m_windowEnd)
+    {
+      // Packets before the window are not read again, their pages are released
+      m_trace->MoveWindow (m_connection, TraceReplayTrace::SERVER, m_windowStart, m_packetIndex, PACKET_WINDOW);
+      m_windowStart = m_packetIndex;
+      m_windowEnd = m_packetIndex + PACKET_WINDOW;
+    }
+  TraceReplayPacket packet = m_trace->GetPacket (m_connection, TraceReplayTrace::SERVER, m_packetIndex++);
+  if (m_packetIndex == m_trace->GetNPackets (m_connection, TraceReplayTrace::SERVER))
+    {
+      // Last packet read, pages of the packets of this side are not needed any more
+      m_trace->MoveWindow (m_connection, TraceReplayTrace::SERVER, m_windowStart, m_packetIndex, 0);
+      m_windowStart = m_packetIndex;
+    }
+  return packet;
+}
 
-  m_packetList = packetList;
-  m_packetListIt = m_packetList.begin ();
+void
+TraceReplayServer::ReleaseConnection (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_replaying)
+    {
+      // Pages of the connection are released once its client and server are both done
+      m_trace->Release (m_connection, TraceReplayTrace::SERVER);
+      m_replaying = false;
+    }
 }
 
 void
@@ -275,7 +358,7 @@ TraceReplayServer::SendPacket (Ptr<Socket> socket, TraceReplayPacket packet)
 
   // Update total byte count for this connection
   m_totByteCount += packet.GetSize ();
-  if (*m_numRepIt > 0)
+  if (m_numRepLeft > 0)
     {
       // more packets are in send queue, schedule next packet
       ScheduleTx (socket);
@@ -283,12 +366,12 @@ TraceReplayServer::SendPacket (Ptr<Socket> socket, TraceReplayPacket packet)
   else
     {
       // update expected number of total bytes to be received
-      m_totExpByte = *(m_expByteIt++);
+      m_totExpByte = GetNextExpByte ();
       m_totRecByte = 0;
-      if (m_numRepIt != m_numRep.end () && *m_numRepIt == 0)
+      if (m_numRepIndex < m_trace->GetNSendCounts (m_connection, TraceReplayTrace::SERVER))
         {
           // update the number of packets to send in next run
-          ++m_numRepIt;
+          m_numRepLeft = GetNumRep (++m_numRepIndex);
         }
       // go to receive mode
       socket->SetRecvCallback (MakeCallback (&TraceReplayServer::ReceivePacket, this));
@@ -299,12 +382,12 @@ void
 TraceReplayServer::ScheduleTx (Ptr<Socket> socket)
 {
   NS_LOG_FUNCTION (this);
-  if (m_connected && *m_numRepIt > 0)
+  if (m_connected && m_numRepLeft > 0)
     {
       // Decrement number of packets to be send
-      *m_numRepIt -= 1;
+      m_numRepLeft -= 1;
 
-      TraceReplayPacket packet = *(m_packetListIt++);
+      TraceReplayPacket packet = GetNextPacket ();
       if ((packet.GetDelay ()).IsStrictlyPositive ())
         {
           // schedule packet after 'delay'
@@ -318,10 +401,10 @@ TraceReplayServer::ScheduleTx (Ptr<Socket> socket)
           return;
         }
     }
-  else if (*m_numRepIt == 0)
+  else if (m_numRepLeft == 0)
     {
       // No more packet to send, update expected number total bytes to be received
-      m_totExpByte = *(m_expByteIt++);
+      m_totExpByte = GetNextExpByte ();
       m_totRecByte = 0;
       // go to recieve mode
       m_socket->SetRecvCallback (MakeCallback (&TraceReplayServer::ReceivePacket, this));
@@ -350,7 +433,7 @@ TraceReplayServer::ReceivePacket (Ptr<Socket> socket)
     {
       socket->SetRecvCallback (MakeCallback (&TraceReplayServer::ReceivePacket, this));
     }
-  else if (m_numRepIt != m_numRep.end () && *m_numRepIt > 0)
+  else if (m_numRepLeft > 0)
     {
       // go to send mode
       ScheduleTx (socket);
@@ -37,6 +37,7 @@ namespace ns3 {
 class Address;
 class Socket;
 class TraceReplayPacket;
+class TraceReplayTrace;
 
 /**
  * \ingroup applications
@@ -45,8 +46,10 @@ class TraceReplayPacket;
  *
  * TraceReplayServer acts as a tcp server, which accepts connection from
  * TraceReplayClient and communicates with it in a request-reply mode.
- * In each cycle, it waits for client to send *m_expByte as request
- * and sends *m_numReq number of packets, from m_packetList, as reply.
+ * In each cycle, it waits for client to send the number of bytes of the
+ * request and sends the number of packets of the reply, from the server
+ * side of its connection in m_trace. Packets and counts are read from
+ * m_trace when they are needed.
  * Before sending a packet, if the delay for the packet > 0 seconds,
  * it also checks the progress of all parallel connections
  * between same client IP and server IP.
@@ -108,6 +111,16 @@ public:
    */
   void Setup (Address address, DataRate dataRate, std::vector<uint32_t> numRep, std::vector<uint32_t> expByte, std::vector<TraceReplayPacket> packetList);
 
+  /**
+   * \brief This method initializes the server object with a connection of a trace.
+   *
+   * \param address address to which server will bind to
+   * \param dataRate The datarate of the sever while sending reply to client
+   * \param trace Trace containing the connection
+   * \param connection Index of the connection in the trace
+   */
+  void Setup (Address address, DataRate dataRate, Ptr<const TraceReplayTrace> trace, uint32_t connection);
+
   /**
    * \brief Returns Ip address of server in the original connection
    *
@@ -186,6 +199,34 @@ private:
    */
   void ReceivePacket (Ptr<Socket> socket);
 
+  /**
+   * \brief Returns the number of packets to send in a reply
+   *
+   * \param index Index of the reply
+   *
+   * \returns Number of packets, 0 if there is no such reply
+   */
+  uint32_t GetNumRep (uint32_t index) const;
+
+  /**
+   * \brief Returns the number of bytes to receive as the next request
+   *
+   * \returns Number of bytes, 0 if there are no more requests
+   */
+  uint32_t GetNextExpByte (void);
+
+  /**
+   * \brief Reads the next packet to send, moving the window of packets read ahead when it is reached
+   *
+   * \returns Next packet to send
+   */
+  TraceReplayPacket GetNextPacket (void);
+
+  /**
+   * \brief Tells the trace that this application does not replay its connection any more
+   */
+  void ReleaseConnection (void);
+
   Ptr<Socket>     m_socket;       //!< Associated socket
   Address         m_local;        //!< Local address
   bool            m_connected;    //!< True if running
@@ -198,13 +239,16 @@ private:
   uint32_t        m_totExpByte;   //!< Total number of bytes expected to receive
   uint32_t        m_totByteCount; //!< Total number of bytes seen in connection (sent + received)
 
-  std::vector<uint32_t>             m_numRep;       //!< List of #packets to send as reply
-  std::vector<uint32_t>             m_expByte;      //!< List of total bytes expected to receive as request
-  std::vector<TraceReplayPacket>    m_packetList;   //!< List of packets
+  Ptr<const TraceReplayTrace> m_trace; //!< Trace containing the packets and counts of the connection
+  uint32_t        m_connection;   //!< Index of the connection in m_trace
+  uint32_t        m_numRepIndex;  //!< Index of the current reply
+  uint32_t        m_numRepLeft;   //!< Number of packets still to send in the current reply
+  uint32_t        m_expByteIndex; //!< Index of the next request
+  uint32_t        m_packetIndex;  //!< Index of the next packet to send
+  uint32_t        m_windowStart;  //!< Index of the first packet of the window read ahead
+  uint32_t        m_windowEnd;    //!< Index after the last packet of the window read ahead
+  bool            m_replaying;    //!< True from Setup until the connection is released in m_trace
 
-  std::vector<uint32_t>::iterator             m_numRepIt;        //!< m_numRep iterator
-  std::vector<uint32_t>::iterator             m_expByteIt;       //!< m_expByte iterator
-  std::vector<TraceReplayPacket>::iterator    m_packetListIt;    //!< m_packetList iterator
   std::vector<Ptr<TraceReplayServer> >        m_parallelConnList; //!< List of all parallel connections
 };
 } // namespace ns3
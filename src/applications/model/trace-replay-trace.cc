@@ -0,0 +1,648 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ */
+
+#include "ns3/log.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv6-address.h"
+#include "ns3/trace-replay-utility.h"
+#include "trace-replay-trace.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("TraceReplayTrace");
+
+// Binary trace file: magic ("TRBT"), version, header size, number of
+// connections and number of packets, then one record per connection.
+// A record is the connection id and start time followed by the offset
+// (from the start of the record) of each of its sections and of its end.
+static const uint32_t BINARY_TRACE_MAGIC = 0x54425254;
+static const uint32_t BINARY_TRACE_VERSION = 2;
+static const uint32_t BINARY_HEADER_SIZE = 24;
+static const uint32_t BINARY_OFFSET_TABLE = 48;
+static const uint32_t BINARY_CONNECTION_SIZE = 120;
+static const uint32_t BINARY_PACKET_SIZE = 16;
+static const uint32_t BINARY_PARALLEL_SIZE = 8;
+static const uint32_t BINARY_COUNT_SIZE = 4;
+
+// Pages of a mapped trace are released in blocks of this size (bytes), the fault-around size of Linux
+static const uint32_t BINARY_RELEASE_BLOCK = 64 * 1024;
+
+/**
+ * \brief Appends an integer to a buffer in little endian byte order
+ *
+ * \param buffer Buffer to append to
+ * \param value Integer to append
+ * \param size Number of bytes to append
+ */
+static void
+PutLittleEndian (std::string& buffer, uint64_t value, uint32_t size)
+{
+  for (uint32_t i = 0; i < size; i++)
+    {
+      buffer.push_back ((char) ((value >> (8 * i)) & 0xff));
+    }
+}
+
+/**
+ * \brief Reads an integer stored in little endian byte order
+ *
+ * \param data Bytes of the integer
+ * \param size Number of bytes
+ *
+ * \returns The integer
+ */
+static uint64_t
+GetLittleEndian (const uint8_t* data, uint32_t size)
+{
+  uint64_t value = 0;
+  for (uint32_t i = 0; i < size; i++)
+    {
+      value |= (uint64_t) data[i] << (8 * i);
+    }
+  return value;
+}
+
+/**
+ * \brief Returns the size of an entry of a section of a connection record
+ *
+ * \param section Index of the section
+ *
+ * \returns Size of an entry (bytes)
+ */
+static uint32_t
+GetEntrySize (uint32_t section)
+{
+  // Each side has packets, parallel connections, and two lists of counts
+  switch (section % 4)
+    {
+    case 0:
+      return BINARY_PACKET_SIZE;
+    case 1:
+      return BINARY_PARALLEL_SIZE;
+    default:
+      return BINARY_COUNT_SIZE;
+    }
+}
+
+TraceReplayTrace::TraceReplayTrace (std::string filename)
+  : m_name (filename),
+    m_data (0),
+    m_size (0),
+    m_mapped (false)
+{
+  NS_LOG_FUNCTION (this << filename);
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      std::cerr << "Error opening trace file " << filename << ".\n";
+      exit (1);
+    }
+  Map (fd);
+  close (fd);
+  IndexConnections ();
+}
+
+TraceReplayTrace::TraceReplayTrace (std::string name, int fd)
+  : m_name (name),
+    m_data (0),
+    m_size (0),
+    m_mapped (false)
+{
+  NS_LOG_FUNCTION (this << name << fd);
+  Map (fd);
+  IndexConnections ();
+}
+
+TraceReplayTrace::TraceReplayTrace (std::string name, std::string image)
+  : m_name (name),
+    m_data (0),
+    m_size (0),
+    m_mapped (false)
+{
+  NS_LOG_FUNCTION (this << name);
+  m_image.swap (image);
+  m_data = (const uint8_t*) m_image.data ();
+  m_size = m_image.size ();
+  IndexConnections ();
+}
+
+TraceReplayTrace::~TraceReplayTrace ()
+{
+  NS_LOG_FUNCTION (this);
+  SharedTraces& shared = GetSharedTraces ();
+  for (SharedTraces::iterator it = shared.begin (); it != shared.end (); )
+    {
+      if (it->second.first == this)
+        {
+          shared.erase (it++);
+        }
+      else
+        {
+          ++it;
+        }
+    }
+  if (m_mapped)
+    {
+      munmap ((void*) m_data, m_size);
+    }
+}
+
+void
+TraceReplayTrace::Map (int fd)
+{
+  NS_LOG_FUNCTION (this << fd);
+  struct stat st;
+  if (fstat (fd, &st) != 0)
+    {
+      std::cerr << "Error opening trace file " << m_name << ".\n";
+      exit (1);
+    }
+  m_size = st.st_size;
+  if (m_size > 0)
+    {
+      // Read-only shared mapping: pages are loaded on first access and shared with other processes
+      void* data = mmap (0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED)
+        {
+          std::cerr << "Error mapping trace file " << m_name << ".\n";
+          exit (1);
+        }
+      m_data = (const uint8_t*) data;
+      m_mapped = true;
+    }
+}
+
+void
+TraceReplayTrace::IndexConnections (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (m_size < BINARY_HEADER_SIZE || GetLittleEndian (m_data, 4) != BINARY_TRACE_MAGIC)
+    {
+      std::cerr << "Trace file " << m_name << " is not a binary trace file.\n";
+      exit (1);
+    }
+  uint32_t version = GetLittleEndian (m_data + 4, 4);
+  uint64_t headerSize = GetLittleEndian (m_data + 8, 4);
+  if (version != BINARY_TRACE_VERSION)
+    {
+      std::cerr << "Trace file " << m_name << " has unsupported version " << version << ".\n";
+      exit (1);
+    }
+  // Every record has at least its fixed part, so the number of connections is
+  // checked before anything is allocated for them
+  uint32_t numConn = GetLittleEndian (m_data + 12, 4);
+  if (headerSize < BINARY_HEADER_SIZE || headerSize > m_size
+      || numConn > (m_size - headerSize) / BINARY_CONNECTION_SIZE)
+    {
+      std::cerr << "Trace file " << m_name << " is cut short.\n";
+      exit (1);
+    }
+
+  // Only the offset table of each record is read, packets are not touched. Every
+  // offset is checked here, so that the sections can be read without checks later.
+  uint64_t offset = headerSize;
+  m_connections.clear ();
+  m_connections.reserve (numConn);
+  for (uint32_t j = 0; j < numConn; j++)
+    {
+      if (BINARY_CONNECTION_SIZE > m_size - offset)
+        {
+          std::cerr << "Trace file " << m_name << " is cut short.\n";
+          exit (1);
+        }
+      const uint8_t* record = m_data + offset;
+      if (GetLittleEndian (record + BINARY_OFFSET_TABLE + 8 * NUM_SECTIONS, 8) > m_size - offset)
+        {
+          std::cerr << "Trace file " << m_name << " is cut short.\n";
+          exit (1);
+        }
+      uint64_t start = BINARY_CONNECTION_SIZE;
+      for (uint32_t s = 0; s < NUM_SECTIONS; s++)
+        {
+          uint64_t end = GetLittleEndian (record + BINARY_OFFSET_TABLE + 8 * (s + 1), 8);
+          if (GetLittleEndian (record + BINARY_OFFSET_TABLE + 8 * s, 8) != start || end < start
+              || (end - start) % GetEntrySize (s) != 0
+              || (end - start) / GetEntrySize (s) > std::numeric_limits<uint32_t>::max ())
+            {
+              std::cerr << "Trace file " << m_name << " is corrupted (connection " << j << ").\n";
+              exit (1);
+            }
+          start = end;
+        }
+      m_connections.push_back (offset);
+      offset += start;
+    }
+  m_users.assign ((uint64_t) numConn * 2, 0);
+}
+
+const uint8_t*
+TraceReplayTrace::GetRecord (uint32_t conn) const
+{
+  NS_ASSERT_MSG (conn < m_connections.size (), "No connection " << conn << " in trace file " << m_name);
+  return m_data + m_connections[conn];
+}
+
+const uint8_t*
+TraceReplayTrace::GetSection (uint32_t conn, Section section, uint32_t& count) const
+{
+  const uint8_t* record = GetRecord (conn);
+  uint64_t start = GetLittleEndian (record + BINARY_OFFSET_TABLE + 8 * section, 8);
+  uint64_t end = GetLittleEndian (record + BINARY_OFFSET_TABLE + 8 * (section + 1), 8);
+  count = (end - start) / GetEntrySize (section);
+  return record + start;
+}
+
+uint32_t
+TraceReplayTrace::GetNConnections (void) const
+{
+  return m_connections.size ();
+}
+
+Address
+TraceReplayTrace::GetIpClient (uint32_t conn) const
+{
+  const uint8_t* record = GetRecord (conn);
+  if (record[36] != 0)
+    {
+      return Ipv6Address::Deserialize (record);
+    }
+  return Ipv4Address::Deserialize (record);
+}
+
+Address
+TraceReplayTrace::GetIpServer (uint32_t conn) const
+{
+  const uint8_t* record = GetRecord (conn);
+  if (record[36] != 0)
+    {
+      return Ipv6Address::Deserialize (record + 16);
+    }
+  return Ipv4Address::Deserialize (record + 16);
+}
+
+uint16_t
+TraceReplayTrace::GetPortClient (uint32_t conn) const
+{
+  return GetLittleEndian (GetRecord (conn) + 32, 2);
+}
+
+uint16_t
+TraceReplayTrace::GetPortServer (uint32_t conn) const
+{
+  return GetLittleEndian (GetRecord (conn) + 34, 2);
+}
+
+Time
+TraceReplayTrace::GetStartTime (uint32_t conn) const
+{
+  return NanoSeconds ((int64_t) GetLittleEndian (GetRecord (conn) + 40, 8));
+}
+
+uint32_t
+TraceReplayTrace::GetNPackets (uint32_t conn, Side side) const
+{
+  uint32_t count;
+  GetSection (conn, side == CLIENT ? CLIENT_PACKETS : SERVER_PACKETS, count);
+  return count;
+}
+
+TraceReplayPacket
+TraceReplayTrace::GetPacket (uint32_t conn, Side side, uint32_t i) const
+{
+  uint32_t numPacket;
+  const uint8_t* packets = GetSection (conn, side == CLIENT ? CLIENT_PACKETS : SERVER_PACKETS, numPacket);
+  uint32_t numParallel;
+  const uint8_t* parallel = GetSection (conn, side == CLIENT ? CLIENT_PARALLEL : SERVER_PARALLEL, numParallel);
+  NS_ASSERT_MSG (i < numPacket, "No packet " << i << " in connection " << conn);
+
+  // Parallel connections of a packet end where those of the next packet start
+  const uint8_t* record = packets + (uint64_t) i * BINARY_PACKET_SIZE;
+  uint32_t first = GetLittleEndian (record + 4, 4);
+  uint32_t last = i + 1 < numPacket ? GetLittleEndian (record + BINARY_PACKET_SIZE + 4, 4) : numParallel;
+  if (first > last || last > numParallel)
+    {
+      std::cerr << "Trace file " << m_name << " is corrupted (connection " << conn << ").\n";
+      exit (1);
+    }
+
+  TraceReplayPacket packet;
+  packet.SetSize (GetLittleEndian (record, 4));
+  packet.SetDelay (NanoSeconds ((int64_t) GetLittleEndian (record + 8, 8)));
+  for (const uint8_t* entry = parallel + (uint64_t) first * BINARY_PARALLEL_SIZE; first < last; first++, entry += BINARY_PARALLEL_SIZE)
+    {
+      packet.AddParallelConnection (GetLittleEndian (entry, 2), GetLittleEndian (entry + 2, 2),
+                                    GetLittleEndian (entry + 4, 4));
+    }
+  return packet;
+}
+
+void
+TraceReplayTrace::MoveWindow (uint32_t conn, Side side, uint32_t from, uint32_t to, uint32_t size) const
+{
+  NS_LOG_FUNCTION (this << conn << side << from << to << size);
+  if (!m_mapped)
+    {
+      // Trace built in memory has no pages to give back
+      return;
+    }
+  uint32_t numPacket = GetNPackets (conn, side);
+  to = std::min (to, numPacket);
+  from = std::min (from, to);
+  if (m_users[conn * 2 + side] <= 1)
+    {
+      // Other applications replaying this side may still be behind
+      AdvisePackets (conn, side, from, to, false);
+    }
+  AdvisePackets (conn, side, to, std::min<uint64_t> ((uint64_t) to + size, numPacket), true);
+}
+
+void
+TraceReplayTrace::AdvisePackets (uint32_t conn, Side side, uint32_t first, uint32_t last, bool needed) const
+{
+  if (first >= last)
+    {
+      return;
+    }
+  uint32_t numPacket;
+  const uint8_t* packets = GetSection (conn, side == CLIENT ? CLIENT_PACKETS : SERVER_PACKETS, numPacket);
+  uint32_t numParallel;
+  const uint8_t* parallel = GetSection (conn, side == CLIENT ? CLIENT_PARALLEL : SERVER_PARALLEL, numParallel);
+  // Parallel connections of the packets are contiguous too. Their bounds are
+  // read first, reading a released packet would fault its block in again.
+  uint32_t firstEntry = std::min<uint64_t> (GetLittleEndian (packets + (uint64_t) first * BINARY_PACKET_SIZE + 4, 4), numParallel);
+  uint32_t lastEntry = numParallel;
+  if (last < numPacket)
+    {
+      lastEntry = std::min<uint64_t> (GetLittleEndian (packets + (uint64_t) last * BINARY_PACKET_SIZE + 4, 4), numParallel);
+    }
+  Advise (packets + (uint64_t) first * BINARY_PACKET_SIZE, packets + (uint64_t) last * BINARY_PACKET_SIZE, needed);
+  if (firstEntry < lastEntry)
+    {
+      Advise (parallel + (uint64_t) firstEntry * BINARY_PARALLEL_SIZE, parallel + (uint64_t) lastEntry * BINARY_PARALLEL_SIZE, needed);
+    }
+}
+
+void
+TraceReplayTrace::Advise (const uint8_t* begin, const uint8_t* end, bool needed) const
+{
+  static const uintptr_t pageSize = sysconf (_SC_PAGESIZE);
+  // A page fault maps every cached page of the block around it, so only whole
+  // blocks stay released. Pages of other connections in the block are read
+  // again from the page cache when those connections reach them.
+  uintptr_t block = needed ? pageSize : std::max<uintptr_t> (pageSize, BINARY_RELEASE_BLOCK);
+  uintptr_t first = (uintptr_t) begin;
+  uintptr_t last = (uintptr_t) end;
+  first = std::max (first - first % block, (uintptr_t) m_data);
+  last = std::min ((last + block - 1) / block * block, (uintptr_t) (m_data + m_size));
+  if (first < last)
+    {
+      madvise ((void*) first, last - first, needed ? MADV_WILLNEED : MADV_DONTNEED);
+    }
+}
+
+void
+TraceReplayTrace::Release (void) const
+{
+  NS_LOG_FUNCTION (this);
+  if (m_mapped)
+    {
+      Advise (m_data, m_data + m_size, false);
+    }
+}
+
+void
+TraceReplayTrace::Acquire (uint32_t conn, Side side) const
+{
+  NS_LOG_FUNCTION (this << conn << side);
+  NS_ASSERT_MSG (conn < GetNConnections (), "No connection " << conn << " in trace file " << m_name);
+  m_users[conn * 2 + side]++;
+}
+
+void
+TraceReplayTrace::Release (uint32_t conn, Side side) const
+{
+  NS_LOG_FUNCTION (this << conn << side);
+  NS_ASSERT_MSG (conn < GetNConnections () && m_users[conn * 2 + side] > 0,
+                 "Connection " << conn << " is not replayed");
+  m_users[conn * 2 + side]--;
+  if (m_users[conn * 2] == 0 && m_users[conn * 2 + 1] == 0 && m_mapped)
+    {
+      const uint8_t* record = GetRecord (conn);
+      Advise (record, record + GetLittleEndian (record + BINARY_OFFSET_TABLE + 8 * NUM_SECTIONS, 8), false);
+    }
+}
+
+uint32_t
+TraceReplayTrace::GetNSendCounts (uint32_t conn, Side side) const
+{
+  uint32_t count;
+  GetSection (conn, side == CLIENT ? NUM_REQ : NUM_REP, count);
+  return count;
+}
+
+uint32_t
+TraceReplayTrace::GetSendCount (uint32_t conn, Side side, uint32_t i) const
+{
+  uint32_t count;
+  const uint8_t* counts = GetSection (conn, side == CLIENT ? NUM_REQ : NUM_REP, count);
+  NS_ASSERT_MSG (i < count, "No cycle " << i << " in connection " << conn);
+  return GetLittleEndian (counts + (uint64_t) i * BINARY_COUNT_SIZE, 4);
+}
+
+uint32_t
+TraceReplayTrace::GetNReceiveCounts (uint32_t conn, Side side) const
+{
+  uint32_t count;
+  GetSection (conn, side == CLIENT ? EXP_BYTE_SERVER : EXP_BYTE_CLIENT, count);
+  return count;
+}
+
+uint32_t
+TraceReplayTrace::GetReceiveCount (uint32_t conn, Side side, uint32_t i) const
+{
+  uint32_t count;
+  const uint8_t* counts = GetSection (conn, side == CLIENT ? EXP_BYTE_SERVER : EXP_BYTE_CLIENT, count);
+  NS_ASSERT_MSG (i < count, "No cycle " << i << " in connection " << conn);
+  return GetLittleEndian (counts + (uint64_t) i * BINARY_COUNT_SIZE, 4);
+}
+
+TraceReplayTrace::SharedTraces&
+TraceReplayTrace::GetSharedTraces (void)
+{
+  // Traces are not referenced from here, the last application using a trace unloads it.
+  // Never destroyed, traces may still be released after static destructors have run.
+  static SharedTraces* shared = new SharedTraces;
+  return *shared;
+}
+
+bool
+TraceReplayTrace::GetFileId (std::string filename, FileId& id)
+{
+  struct stat st;
+  if (stat (filename.c_str (), &st) != 0)
+    {
+      return false;
+    }
+  id.device = st.st_dev;
+  id.inode = st.st_ino;
+  id.size = st.st_size;
+  id.modified = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  return true;
+}
+
+void
+TraceReplayTrace::Share (std::string filename, Ptr<const TraceReplayTrace> trace)
+{
+  NS_LOG_FUNCTION (filename);
+  FileId id;
+  if (GetFileId (filename, id))
+    {
+      GetSharedTraces ()[std::make_pair (id.device, id.inode)] = std::make_pair (PeekPointer (trace), id);
+    }
+}
+
+Ptr<const TraceReplayTrace>
+TraceReplayTrace::Find (std::string filename)
+{
+  NS_LOG_FUNCTION (filename);
+  FileId id;
+  if (!GetFileId (filename, id))
+    {
+      return 0;
+    }
+  SharedTraces& shared = GetSharedTraces ();
+  SharedTraces::iterator it = shared.find (std::make_pair (id.device, id.inode));
+  if (it == shared.end () || it->second.second.size != id.size || it->second.second.modified != id.modified)
+    {
+      // File was changed (or replaced) since it was loaded
+      return 0;
+    }
+  return Ptr<const TraceReplayTrace> (it->second.first);
+}
+
+bool
+TraceReplayTrace::IsBinaryTrace (std::string filename)
+{
+  std::ifstream file (filename.c_str (), std::ios::in | std::ios::binary);
+  uint8_t magic[4] = { 0, 0, 0, 0 };
+  file.read ((char*) magic, 4);
+  return file.gcount () == 4 && GetLittleEndian (magic, 4) == BINARY_TRACE_MAGIC;
+}
+
+void
+TraceReplayTrace::WriteHeader (std::string& buffer, uint32_t numConnections, uint64_t numPackets)
+{
+  PutLittleEndian (buffer, BINARY_TRACE_MAGIC, 4);
+  PutLittleEndian (buffer, BINARY_TRACE_VERSION, 4);
+  PutLittleEndian (buffer, BINARY_HEADER_SIZE, 4);
+  PutLittleEndian (buffer, numConnections, 4);
+  PutLittleEndian (buffer, numPackets, 8);
+}
+
+void
+TraceReplayTrace::WriteConnection (std::string& buffer, const uint8_t* ipClient, uint16_t portClient,
+                                   const uint8_t* ipServer, uint16_t portServer, bool ipv6, Time startTime,
+                                   const std::vector<TraceReplayPacket>& clientPackets,
+                                   const std::vector<uint32_t>& numReq, const std::vector<uint32_t>& expByteServer,
+                                   const std::vector<TraceReplayPacket>& serverPackets,
+                                   const std::vector<uint32_t>& numRep, const std::vector<uint32_t>& expByteClient)
+{
+  // Parallel connections are stored only for packets with a delay, as in the text format
+  std::vector<TraceReplayPacket> const* packets[2] = { &clientPackets, &serverPackets };
+  uint64_t numParallel[2] = { 0, 0 };
+  for (uint32_t side = 0; side < 2; side++)
+    {
+      for (uint32_t i = 0; i < packets[side]->size (); i++)
+        {
+          const TraceReplayPacket& packet = (*packets[side])[i];
+          if ((packet.GetDelay ()).IsStrictlyPositive ())
+            {
+              numParallel[side] += packet.GetNumParallelConnection ();
+            }
+        }
+    }
+  std::vector<uint32_t> const* counts[4] = { &numReq, &expByteServer, &numRep, &expByteClient };
+  uint64_t numEntries[NUM_SECTIONS] = { clientPackets.size (), numParallel[0], numReq.size (), expByteServer.size (),
+                                        serverPackets.size (), numParallel[1], numRep.size (), expByteClient.size () };
+
+  buffer.append ((const char*) ipClient, 16);
+  buffer.append ((const char*) ipServer, 16);
+  PutLittleEndian (buffer, portClient, 2);
+  PutLittleEndian (buffer, portServer, 2);
+  PutLittleEndian (buffer, ipv6, 1);
+  PutLittleEndian (buffer, 0, 3);
+  PutLittleEndian (buffer, startTime.GetNanoSeconds (), 8);
+  uint64_t offset = BINARY_CONNECTION_SIZE;
+  for (uint32_t s = 0; s < NUM_SECTIONS; s++)
+    {
+      PutLittleEndian (buffer, offset, 8);
+      offset += numEntries[s] * GetEntrySize (s);
+    }
+  PutLittleEndian (buffer, offset, 8);
+
+  for (uint32_t side = 0; side < 2; side++)
+    {
+      // Each packet has the index of its first parallel connection in the next section
+      uint32_t first = 0;
+      for (uint32_t i = 0; i < packets[side]->size (); i++)
+        {
+          const TraceReplayPacket& packet = (*packets[side])[i];
+          PutLittleEndian (buffer, packet.GetSize (), 4);
+          PutLittleEndian (buffer, first, 4);
+          PutLittleEndian (buffer, (packet.GetDelay ()).GetNanoSeconds (), 8);
+          if ((packet.GetDelay ()).IsStrictlyPositive ())
+            {
+              first += packet.GetNumParallelConnection ();
+            }
+        }
+      for (uint32_t i = 0; i < packets[side]->size (); i++)
+        {
+          const TraceReplayPacket& packet = (*packets[side])[i];
+          uint32_t numParallelCon = (packet.GetDelay ()).IsStrictlyPositive () ? packet.GetNumParallelConnection () : 0;
+          for (uint32_t j = 0; j < numParallelCon; j++)
+            {
+              std::pair<uint16_t, uint16_t> connId = packet.GetConnectionId (j);
+              PutLittleEndian (buffer, connId.first, 2);
+              PutLittleEndian (buffer, connId.second, 2);
+              PutLittleEndian (buffer, packet.GetByteCount (j), 4);
+            }
+        }
+      for (uint32_t k = 2 * side; k < 2 * side + 2; k++)
+        {
+          for (uint32_t i = 0; i < counts[k]->size (); i++)
+            {
+              PutLittleEndian (buffer, (*counts[k])[i], 4);
+            }
+        }
+    }
+}
+
+} // namespace ns3
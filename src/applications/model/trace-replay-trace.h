@@ -0,0 +1,452 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Prakash Agrawal <prakashagr@cse.iitb.ac.in, prakash9752@gmail.com>
+ *         Prof. Mythili Vutukuru <mythili@cse.iitb.ac.in>
+ * Refrence: https://goo.gl/Z4ZW2K
+ */
+
+#ifndef TRACE_REPLAY_TRACE_H
+#define TRACE_REPLAY_TRACE_H
+
+#include "ns3/address.h"
+#include "ns3/nstime.h"
+#include "ns3/ptr.h"
+#include "ns3/simple-ref-count.h"
+#include <string>
+#include <vector>
+#include <map>
+
+namespace ns3 {
+
+class TraceReplayPacket;
+
+/**
+ * \ingroup applications
+ * \class TraceReplayTrace
+ * \brief TraceReplayTrace gives read-only access to the connections of a binary trace file.
+ *
+ * The binary trace file (see TraceReplayHelper::SetBinaryTrace) is mapped
+ * into memory and is not decoded when it is loaded: only the header of each
+ * connection record is read, to find where the connection starts. Each
+ * record starts with an offset table of its sections (packets and parallel
+ * connections of each side, and packet and byte counts of each cycle), so
+ * TraceReplayClient and TraceReplayServer read the size, delay and
+ * parallel connections of a packet, or the count of a cycle, from the
+ * mapping only when they need it. Pages of the file are shared with every
+ * other process replaying it.
+ *
+ * A text trace file is converted to the same layout in memory.
+ *
+ * A TraceReplayTrace is never modified once it is loaded. The trace of a
+ * file can be shared (see Share and Find) by every node replaying the file:
+ * the applications of each node only keep their position in it.
+ */
+class TraceReplayTrace : public SimpleRefCount<TraceReplayTrace>
+{
+public:
+  /**
+   * \brief Side of a connection
+   */
+  enum Side
+  {
+    CLIENT = 0,   //!< Client side (packets sent by the client)
+    SERVER = 1    //!< Server side (packets sent by the server)
+  };
+
+  /**
+   * \brief Maps a binary trace file
+   *
+   * The file is checked only once, so it must not be changed in place while
+   * the trace exists. The conversions, including AppendPcap, write a new
+   * file and rename it over the old one, which stays mapped.
+   *
+   * \param filename Name of the binary trace file
+   */
+  TraceReplayTrace (std::string filename);
+
+  /**
+   * \brief Maps a binary trace file which is already open
+   *
+   * The descriptor can be closed, and the file unlinked, once the trace is built.
+   *
+   * \param name Name of the trace, for error messages
+   * \param fd Descriptor of the file, open for reading
+   */
+  TraceReplayTrace (std::string name, int fd);
+
+  /**
+   * \brief Uses a binary trace built in memory
+   *
+   * \param name Name of the trace, for error messages
+   * \param image Contents of the trace, as written by WriteHeader and WriteConnection
+   */
+  TraceReplayTrace (std::string name, std::string image);
+
+  ~TraceReplayTrace ();
+
+  /**
+   * \brief Returns the number of connections in the trace
+   *
+   * \returns Number of connections
+   */
+  uint32_t GetNConnections (void) const;
+
+  /**
+   * \brief Returns real Ip address of client of a connection
+   *
+   * \param conn Index of the connection
+   *
+   * \returns Address of client in trace file
+   */
+  Address GetIpClient (uint32_t conn) const;
+
+  /**
+   * \brief Returns real Ip address of server of a connection
+   *
+   * \param conn Index of the connection
+   *
+   * \returns Address of server in trace file
+   */
+  Address GetIpServer (uint32_t conn) const;
+
+  /**
+   * \brief Returns real port number of client of a connection
+   *
+   * \param conn Index of the connection
+   *
+   * \returns Port number of client in trace file
+   */
+  uint16_t GetPortClient (uint32_t conn) const;
+
+  /**
+   * \brief Returns real port number of server of a connection
+   *
+   * \param conn Index of the connection
+   *
+   * \returns Port number of server in trace file
+   */
+  uint16_t GetPortServer (uint32_t conn) const;
+
+  /**
+   * \brief Returns start time of a connection
+   *
+   * \param conn Index of the connection
+   *
+   * \returns Start time of connection in trace file
+   */
+  Time GetStartTime (uint32_t conn) const;
+
+  /**
+   * \brief Returns the number of packets sent by one side of a connection
+   *
+   * \param conn Index of the connection
+   * \param side Side sending the packets
+   *
+   * \returns Number of packets
+   */
+  uint32_t GetNPackets (uint32_t conn, Side side) const;
+
+  /**
+   * \brief Reads a packet sent by one side of a connection
+   *
+   * \param conn Index of the connection
+   * \param side Side sending the packet
+   * \param i Index of the packet
+   *
+   * \returns Size, delay and parallel connections of the packet
+   */
+  TraceReplayPacket GetPacket (uint32_t conn, Side side, uint32_t i) const;
+
+  /**
+   * \brief Moves the window of packets of one side of a connection which are being replayed
+   *
+   * Pages of the packets before the new window are released, they are read
+   * again from the file if needed later, unless other applications replay the
+   * same side of the connection (see Acquire). Pages of the new window are
+   * read ahead.
+   * Does nothing for a trace built in memory.
+   *
+   * \param conn Index of the connection
+   * \param side Side sending the packets
+   * \param from Index of the first packet of the old window
+   * \param to Index of the first packet of the new window
+   * \param size Number of packets in the new window
+   */
+  void MoveWindow (uint32_t conn, Side side, uint32_t from, uint32_t to, uint32_t size) const;
+
+  /**
+   * \brief Releases every page of a mapped trace
+   *
+   * Pages are read again from the file when a connection is replayed, so that
+   * connections which have not started take no memory. Meant for a trace
+   * which was just loaded, as pages of connections being replayed are
+   * released too. Does nothing for a trace built in memory.
+   */
+  void Release (void) const;
+
+  /**
+   * \brief Registers an application which replays one side of a connection
+   *
+   * The client and server of a connection, and those of every node sharing
+   * the trace, read the same pages. Each of them calls Acquire once, when it
+   * is set up, and Release once, when it is done. Users are counted per side,
+   * as a client only moves the window of the packets it sends.
+   *
+   * \param conn Index of the connection
+   * \param side Side replayed by the application
+   */
+  void Acquire (uint32_t conn, Side side) const;
+
+  /**
+   * \brief Unregisters an application which has replayed one side of a connection
+   *
+   * Pages of the connection are released once no application replays either side.
+   *
+   * \param conn Index of the connection
+   * \param side Side replayed by the application
+   */
+  void Release (uint32_t conn, Side side) const;
+
+  /**
+   * \brief Returns the number of cycles in which one side of a connection sends packets
+   *
+   * \param conn Index of the connection
+   * \param side Side sending the packets
+   *
+   * \returns Number of requests (client) or replies (server)
+   */
+  uint32_t GetNSendCounts (uint32_t conn, Side side) const;
+
+  /**
+   * \brief Returns the number of packets one side of a connection sends in a cycle
+   *
+   * \param conn Index of the connection
+   * \param side Side sending the packets
+   * \param i Index of the cycle
+   *
+   * \returns Number of packets to send before going to receive mode
+   */
+  uint32_t GetSendCount (uint32_t conn, Side side, uint32_t i) const;
+
+  /**
+   * \brief Returns the number of cycles in which one side of a connection receives bytes
+   *
+   * \param conn Index of the connection
+   * \param side Side receiving the bytes
+   *
+   * \returns Number of replies (client) or requests (server)
+   */
+  uint32_t GetNReceiveCounts (uint32_t conn, Side side) const;
+
+  /**
+   * \brief Returns the number of bytes one side of a connection receives in a cycle
+   *
+   * \param conn Index of the connection
+   * \param side Side receiving the bytes
+   * \param i Index of the cycle
+   *
+   * \returns Number of bytes to receive before going to send mode
+   */
+  uint32_t GetReceiveCount (uint32_t conn, Side side, uint32_t i) const;
+
+  /**
+   * \brief Makes a trace available to later Find calls for the same file
+   *
+   * The trace is shared as long as it is referenced; it is not kept alive
+   * by being shared.
+   *
+   * \param filename Name of the file the trace was loaded from
+   * \param trace Trace loaded from the file
+   */
+  static void Share (std::string filename, Ptr<const TraceReplayTrace> trace);
+
+  /**
+   * \brief Finds the shared trace of a file
+   *
+   * A file is identified by its device and inode, so a file which was
+   * renamed or reached through another path is still found. The trace is
+   * not used if the size or modification time (to the nanosecond) of the
+   * file has changed since it was shared. A trace file written again by a
+   * conversion or AppendPcap is a new file, with another inode.
+   *
+   * \param filename Name of the file
+   *
+   * \returns The trace of the file, or 0 if it is not loaded
+   */
+  static Ptr<const TraceReplayTrace> Find (std::string filename);
+
+  /**
+   * \brief Checks whether a file is a binary trace file
+   *
+   * \param filename Name of the file
+   *
+   * \returns True if the file starts with the magic number of binary trace files
+   */
+  static bool IsBinaryTrace (std::string filename);
+
+  /**
+   * \brief Appends the header of a binary trace
+   *
+   * The header has a fixed size, it can be written again in place once
+   * the counts are known.
+   *
+   * \param buffer Buffer to append to
+   * \param numConnections Number of connections in the trace
+   * \param numPackets Number of packets in the trace
+   */
+  static void WriteHeader (std::string& buffer, uint32_t numConnections, uint64_t numPackets);
+
+  /**
+   * \brief Appends the record of a connection to a binary trace
+   *
+   * \param buffer Buffer to append to
+   * \param ipClient Real ip address of client (16 bytes, an ipv4 address in the first 4)
+   * \param portClient Real port number of client
+   * \param ipServer Real ip address of server (16 bytes, an ipv4 address in the first 4)
+   * \param portServer Real port number of server
+   * \param ipv6 True if the addresses are ipv6 addresses
+   * \param startTime Start time of connection
+   * \param clientPackets Packets sent by client
+   * \param numReq Number of packets sent by client in each request
+   * \param expByteServer Number of bytes client receives in each reply
+   * \param serverPackets Packets sent by server
+   * \param numRep Number of packets sent by server in each reply
+   * \param expByteClient Number of bytes server receives in each request
+   */
+  static void WriteConnection (std::string& buffer, const uint8_t* ipClient, uint16_t portClient,
+                               const uint8_t* ipServer, uint16_t portServer, bool ipv6, Time startTime,
+                               const std::vector<TraceReplayPacket>& clientPackets,
+                               const std::vector<uint32_t>& numReq, const std::vector<uint32_t>& expByteServer,
+                               const std::vector<TraceReplayPacket>& serverPackets,
+                               const std::vector<uint32_t>& numRep, const std::vector<uint32_t>& expByteClient);
+
+private:
+  /**
+   * \brief Sections of a connection record, in the order they are written
+   */
+  enum Section
+  {
+    CLIENT_PACKETS = 0,
+    CLIENT_PARALLEL,
+    NUM_REQ,
+    EXP_BYTE_SERVER,
+    SERVER_PACKETS,
+    SERVER_PARALLEL,
+    NUM_REP,
+    EXP_BYTE_CLIENT,
+    NUM_SECTIONS
+  };
+
+  /**
+   * \brief Checks the header and finds the offset of each connection record
+   */
+  void IndexConnections (void);
+
+  /**
+   * \brief Maps the whole of an open file read-only
+   *
+   * \param fd Descriptor of the file
+   */
+  void Map (int fd);
+
+  /**
+   * \brief Returns the start of a connection record
+   *
+   * \param conn Index of the connection
+   *
+   * \returns Pointer to the record
+   */
+  const uint8_t* GetRecord (uint32_t conn) const;
+
+  /**
+   * \brief Finds a section of a connection record
+   *
+   * \param conn Index of the connection
+   * \param section Section to find
+   * \param count Set to the number of entries in the section
+   *
+   * \returns Pointer to the first entry of the section
+   */
+  const uint8_t* GetSection (uint32_t conn, Section section, uint32_t& count) const;
+
+  /**
+   * \brief Gives advice on the pages of a range of packets and of their parallel connections
+   *
+   * \param conn Index of the connection
+   * \param side Side sending the packets
+   * \param first Index of the first packet
+   * \param last Index after the last packet
+   * \param needed True to read the pages ahead, false to release them
+   */
+  void AdvisePackets (uint32_t conn, Side side, uint32_t first, uint32_t last, bool needed) const;
+
+  /**
+   * \brief Gives advice on the pages of a range of the mapping
+   *
+   * \param begin Start of the range
+   * \param end End of the range
+   * \param needed True to read ahead the pages overlapping the range, false
+   *        to release the blocks of pages overlapping it
+   */
+  void Advise (const uint8_t* begin, const uint8_t* end, bool needed) const;
+
+  /**
+   * \brief Identity of a shared trace file
+   */
+  struct FileId
+  {
+    uint64_t device;          //!< Device of the file
+    uint64_t inode;           //!< Inode of the file
+    uint64_t size;            //!< Size of the file when it was loaded
+    int64_t  modified;        //!< Modification time of the file when it was loaded (ns)
+  };
+
+  /**
+   * \brief Shared traces, by device and inode of their file, with the identity of their file
+   */
+  typedef std::map<std::pair<uint64_t, uint64_t>, std::pair<const TraceReplayTrace*, FileId> > SharedTraces;
+
+  /**
+   * \brief Gets the identity of a file
+   *
+   * \param filename Name of the file
+   * \param id Set to the identity of the file
+   *
+   * \returns False if the file does not exist
+   */
+  static bool GetFileId (std::string filename, FileId& id);
+
+  /**
+   * \brief Returns the traces shared by Share, by device and inode of their file
+   *
+   * \returns Shared traces, with the identity of their file
+   */
+  static SharedTraces& GetSharedTraces (void);
+
+  std::string             m_name;         //!< Name of the trace file
+  std::string             m_image;        //!< Contents of a trace built in memory
+  const uint8_t*          m_data;         //!< Start of the trace (mapping or m_image)
+  uint64_t                m_size;         //!< Size of the trace
+  bool                    m_mapped;       //!< True if m_data is a mapping of the file
+  std::vector<uint64_t>   m_connections;  //!< Offset of each connection record
+  mutable std::vector<uint32_t> m_users;  //!< Number of applications replaying each side of each connection, client then server (see Acquire)
+};
+
+} // namespace ns3
+
+#endif /* TRACE_REPLAY_TRACE_H */
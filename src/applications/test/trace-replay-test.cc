@@ -0,0 +1,470 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2015 Indian Institute of Technology Bombay
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/test.h"
+#include "ns3/log.h"
+#include "ns3/nstime.h"
+#include "ns3/data-rate.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv6-address.h"
+#include "ns3/trace-replay-helper.h"
+#include "ns3/trace-replay-trace.h"
+#include "ns3/trace-replay-utility.h"
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("TraceReplayTest");
+
+/**
+ * \brief Appends an integer to a pcap in little endian byte order
+ *
+ * \param pcap Pcap contents
+ * \param value Value to append
+ * \param size Number of bytes
+ */
+static void
+AppendLittle (std::string& pcap, uint32_t value, uint32_t size)
+{
+  for (uint32_t i = 0; i < size; i++)
+    {
+      pcap.push_back ((char) (value >> (8 * i)));
+    }
+}
+
+/**
+ * \brief Appends an integer to a frame in network byte order
+ *
+ * \param frame Frame contents
+ * \param value Value to append
+ * \param size Number of bytes
+ */
+static void
+AppendBig (std::string& frame, uint32_t value, uint32_t size)
+{
+  for (uint32_t i = size; i > 0; i--)
+    {
+      frame.push_back ((char) (value >> (8 * (i - 1))));
+    }
+}
+
+/**
+ * \brief Adds an ethernet frame with an IPv4 TCP segment to a capture
+ *
+ * \param frames Frames of the capture by time
+ * \param time Capture time (microseconds)
+ * \param src Source ip address
+ * \param portSrc Source port number
+ * \param dst Destination ip address
+ * \param portDst Destination port number
+ * \param seq Sequence number
+ * \param ack Acknowledgement number
+ * \param flags TCP flags
+ * \param payloadSize Number of payload bytes
+ */
+static void
+AddSegment (std::map<uint64_t, std::string>& frames, uint64_t time, Ipv4Address src, uint16_t portSrc,
+            Ipv4Address dst, uint16_t portDst, uint32_t seq, uint32_t ack, uint8_t flags, uint32_t payloadSize)
+{
+  std::string frame (12, '\0');
+  AppendBig (frame, 0x0800, 2);
+  AppendBig (frame, 0x4500, 2);
+  AppendBig (frame, 40 + payloadSize, 2);
+  AppendBig (frame, 0x00004000, 4);
+  AppendBig (frame, 0x4006, 2);
+  AppendBig (frame, 0, 2);
+  AppendBig (frame, src.Get (), 4);
+  AppendBig (frame, dst.Get (), 4);
+  AppendBig (frame, portSrc, 2);
+  AppendBig (frame, portDst, 2);
+  AppendBig (frame, seq, 4);
+  AppendBig (frame, ack, 4);
+  AppendBig (frame, 0x50, 1);
+  AppendBig (frame, flags, 1);
+  AppendBig (frame, 0xffff0000, 4);
+  AppendBig (frame, 0, 2);
+  frame.append (payloadSize, 'x');
+  frames[time] = frame;
+}
+
+/**
+ * \brief Adds a connection with one request and one reply to a capture
+ *
+ * \param frames Frames of the capture by time
+ * \param time Time of the SYN (microseconds)
+ * \param client Ip address of the host sending the SYN
+ * \param portClient Port number of the client
+ * \param server Ip address of the server
+ * \param portServer Port number of the server
+ * \param request Size of the request
+ * \param reply Size of the reply
+ */
+static void
+AddConnection (std::map<uint64_t, std::string>& frames, uint64_t time, Ipv4Address client, uint16_t portClient,
+               Ipv4Address server, uint16_t portServer, uint32_t request, uint32_t reply)
+{
+  uint32_t seqClient = 1000;
+  uint32_t seqServer = 5000;
+  AddSegment (frames, time, client, portClient, server, portServer, seqClient++, 0, 0x02, 0);
+  AddSegment (frames, time + 10000, server, portServer, client, portClient, seqServer++, seqClient, 0x12, 0);
+  AddSegment (frames, time + 20000, client, portClient, server, portServer, seqClient, seqServer, 0x10, 0);
+  AddSegment (frames, time + 30000, client, portClient, server, portServer, seqClient, seqServer, 0x18, request);
+  seqClient += request;
+  AddSegment (frames, time + 40000, server, portServer, client, portClient, seqServer, seqClient, 0x18, reply);
+  seqServer += reply;
+  AddSegment (frames, time + 50000, client, portClient, server, portServer, seqClient++, seqServer, 0x11, 0);
+  AddSegment (frames, time + 60000, server, portServer, client, portClient, seqServer++, seqClient, 0x11, 0);
+  AddSegment (frames, time + 70000, client, portClient, server, portServer, seqClient, seqServer, 0x10, 0);
+}
+
+/**
+ * \brief Writes a capture to a pcap file
+ *
+ * \param filename Path of the pcap file
+ * \param frames Frames of the capture by time
+ *
+ * \returns True if the file was written
+ */
+static bool
+WritePcap (std::string filename, const std::map<uint64_t, std::string>& frames)
+{
+  std::string pcap;
+  AppendLittle (pcap, 0xa1b2c3d4, 4);
+  AppendLittle (pcap, 2, 2);
+  AppendLittle (pcap, 4, 2);
+  AppendLittle (pcap, 0, 4);
+  AppendLittle (pcap, 0, 4);
+  AppendLittle (pcap, 65535, 4);
+  AppendLittle (pcap, 1, 4);
+  std::map<uint64_t, std::string>::const_iterator it;
+  for (it = frames.begin (); it != frames.end (); it++)
+    {
+      AppendLittle (pcap, it->first / 1000000, 4);
+      AppendLittle (pcap, it->first % 1000000, 4);
+      AppendLittle (pcap, it->second.size (), 4);
+      AppendLittle (pcap, it->second.size (), 4);
+      pcap.append (it->second);
+    }
+  std::ofstream file (filename.c_str (), std::ios::binary);
+  file.write (pcap.data (), pcap.size ());
+  file.close ();
+  return !file.fail ();
+}
+
+/**
+ * \ingroup applications
+ * \brief Checks that a client subnet keeps the connections opened by its hosts only
+ *
+ * The pcap has an outbound connection from a host of the subnet and an inbound
+ * connection to a server of the subnet, whose packets interleave.
+ */
+class TraceReplaySubnetTestCase : public TestCase
+{
+public:
+  /**
+   * \brief Constructor
+   *
+   * \param streaming True to convert in streaming mode
+   */
+  TraceReplaySubnetTestCase (bool streaming);
+  virtual ~TraceReplaySubnetTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  bool m_streaming; //!< True to convert in streaming mode
+};
+
+TraceReplaySubnetTestCase::TraceReplaySubnetTestCase (bool streaming)
+  : TestCase (streaming ? "Client subnet filter, streaming conversion" : "Client subnet filter"),
+    m_streaming (streaming)
+{
+}
+
+TraceReplaySubnetTestCase::~TraceReplaySubnetTestCase ()
+{
+}
+
+void
+TraceReplaySubnetTestCase::DoRun (void)
+{
+  // Segments of both connections interleave
+  std::map<uint64_t, std::string> frames;
+  AddConnection (frames, 1000000000, Ipv4Address ("10.0.0.5"), 40000, Ipv4Address ("8.8.8.8"), 80, 100, 500);
+  AddConnection (frames, 1000005000, Ipv4Address ("1.2.3.4"), 50000, Ipv4Address ("10.0.0.9"), 80, 200, 700);
+  std::string pcapFile = CreateTempDirFilename ("trace-replay-subnet.pcap");
+  std::string traceFile = CreateTempDirFilename ("trace-replay-subnet.bin");
+  NS_TEST_ASSERT_MSG_EQ (WritePcap (pcapFile, frames), true, "Error writing " << pcapFile);
+
+  TraceReplayHelper helper (DataRate ("100Mbps"));
+  helper.SetPcap (pcapFile);
+  helper.SetBinaryTrace (true);
+  helper.SetStreaming (m_streaming);
+  helper.SetClientSubnet (Ipv4Address ("10.0.0.0"), Ipv4Mask ("255.0.0.0"));
+  helper.ConvertPcap (traceFile);
+
+  TraceReplayTrace trace (traceFile);
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNConnections (), 1, "Connection to a server of the subnet is not dropped");
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::ConvertFrom (trace.GetIpClient (0)), Ipv4Address ("10.0.0.5"), "Wrong client");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPortClient (0), 40000, "Wrong client port");
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::ConvertFrom (trace.GetIpServer (0)), Ipv4Address ("8.8.8.8"), "Wrong server");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPortServer (0), 80, "Wrong server port");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNPackets (0, TraceReplayTrace::CLIENT), 1, "Wrong request");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPacket (0, TraceReplayTrace::CLIENT, 0).GetSize (), 100, "Wrong request size");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNPackets (0, TraceReplayTrace::SERVER), 1, "Wrong reply");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPacket (0, TraceReplayTrace::SERVER, 0).GetSize (), 500, "Wrong reply size");
+}
+
+/**
+ * \brief Writes a file
+ *
+ * \param filename Path of the file
+ * \param contents Contents of the file
+ *
+ * \returns True if the file was written
+ */
+static bool
+WriteFile (std::string filename, const std::string& contents)
+{
+  std::ofstream file (filename.c_str (), std::ios::binary);
+  file.write (contents.data (), contents.size ());
+  file.close ();
+  return !file.fail ();
+}
+
+/**
+ * \brief Overwrites an integer of a binary trace, in little endian byte order
+ *
+ * \param image Contents of the trace
+ * \param offset Offset of the integer
+ * \param value New value
+ * \param size Number of bytes
+ */
+static void
+Patch (std::string& image, uint64_t offset, uint64_t value, uint32_t size)
+{
+  for (uint32_t i = 0; i < size; i++)
+    {
+      image[offset + i] = (char) (value >> (8 * i));
+    }
+}
+
+/**
+ * \brief Loads a trace file in a child process
+ *
+ * Errors in a trace file exit the process, so they are checked in a child.
+ *
+ * \param filename Path of the trace file
+ *
+ * \returns Exit status of the child: 0 if the trace was loaded, -1 if it crashed
+ */
+static int
+LoadInChild (std::string filename)
+{
+  // Output buffered so far must not be written again by the child
+  std::fflush (0);
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      TraceReplayTrace trace (filename);
+      _exit (trace.GetNConnections () > 0 ? 0 : 2);
+    }
+  int status;
+  if (pid < 0 || waitpid (pid, &status, 0) != pid || !WIFEXITED (status))
+    {
+      return -1;
+    }
+  return WEXITSTATUS (status);
+}
+
+/**
+ * \ingroup applications
+ * \brief Checks that a binary trace gives back every field written by WriteHeader and WriteConnection,
+ * and that a corrupted trace file is rejected with an error instead of being read
+ */
+class TraceReplayBinaryTraceTestCase : public TestCase
+{
+public:
+  TraceReplayBinaryTraceTestCase ();
+  virtual ~TraceReplayBinaryTraceTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * \brief Checks the connections of a trace against the ones written by DoRun
+   *
+   * \param trace Trace to check
+   */
+  void CheckTrace (const TraceReplayTrace& trace);
+};
+
+TraceReplayBinaryTraceTestCase::TraceReplayBinaryTraceTestCase ()
+  : TestCase ("Binary trace round trip and corrupted files")
+{
+}
+
+TraceReplayBinaryTraceTestCase::~TraceReplayBinaryTraceTestCase ()
+{
+}
+
+void
+TraceReplayBinaryTraceTestCase::CheckTrace (const TraceReplayTrace& trace)
+{
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNConnections (), 2, "Wrong number of connections");
+
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::ConvertFrom (trace.GetIpClient (0)), Ipv4Address ("10.0.0.5"), "Wrong client");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPortClient (0), 40000, "Wrong client port");
+  NS_TEST_ASSERT_MSG_EQ (Ipv4Address::ConvertFrom (trace.GetIpServer (0)), Ipv4Address ("8.8.8.8"), "Wrong server");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPortServer (0), 80, "Wrong server port");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetStartTime (0), MicroSeconds (1500), "Wrong start time");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNPackets (0, TraceReplayTrace::CLIENT), 2, "Wrong client packets");
+  TraceReplayPacket packet = trace.GetPacket (0, TraceReplayTrace::CLIENT, 0);
+  NS_TEST_ASSERT_MSG_EQ (packet.GetSize (), 300, "Wrong packet size");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetDelay (), MilliSeconds (20), "Wrong packet delay");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetNumParallelConnection (), 2, "Wrong parallel connections");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetConnectionId (0).first, 40001, "Wrong parallel client port");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetConnectionId (0).second, 80, "Wrong parallel server port");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetByteCount (0), 1000, "Wrong parallel byte count");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetConnectionId (1).first, 40002, "Wrong parallel client port");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetByteCount (1), 2000, "Wrong parallel byte count");
+  packet = trace.GetPacket (0, TraceReplayTrace::CLIENT, 1);
+  NS_TEST_ASSERT_MSG_EQ (packet.GetSize (), 1460, "Wrong packet size");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetDelay (), Seconds (0), "Wrong packet delay");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetNumParallelConnection (), 0, "Parallel connections of a packet without delay");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNSendCounts (0, TraceReplayTrace::CLIENT), 1, "Wrong requests");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetSendCount (0, TraceReplayTrace::CLIENT, 0), 2, "Wrong request");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNReceiveCounts (0, TraceReplayTrace::CLIENT), 1, "Wrong replies");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetReceiveCount (0, TraceReplayTrace::CLIENT, 0), 500, "Wrong reply");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNPackets (0, TraceReplayTrace::SERVER), 1, "Wrong server packets");
+  packet = trace.GetPacket (0, TraceReplayTrace::SERVER, 0);
+  NS_TEST_ASSERT_MSG_EQ (packet.GetSize (), 500, "Wrong packet size");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetDelay (), MilliSeconds (5), "Wrong packet delay");
+  NS_TEST_ASSERT_MSG_EQ (packet.GetNumParallelConnection (), 0, "Wrong parallel connections");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNSendCounts (0, TraceReplayTrace::SERVER), 1, "Wrong replies");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetSendCount (0, TraceReplayTrace::SERVER, 0), 1, "Wrong reply");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNReceiveCounts (0, TraceReplayTrace::SERVER), 1, "Wrong requests");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetReceiveCount (0, TraceReplayTrace::SERVER, 0), 1760, "Wrong request");
+
+  NS_TEST_ASSERT_MSG_EQ (Ipv6Address::ConvertFrom (trace.GetIpClient (1)), Ipv6Address ("2001:db8::5"), "Wrong client");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPortClient (1), 50000, "Wrong client port");
+  NS_TEST_ASSERT_MSG_EQ (Ipv6Address::ConvertFrom (trace.GetIpServer (1)), Ipv6Address ("2001:db8::1"), "Wrong server");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetPortServer (1), 443, "Wrong server port");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetStartTime (1), Seconds (2), "Wrong start time");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNPackets (1, TraceReplayTrace::CLIENT), 0, "Wrong client packets");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNSendCounts (1, TraceReplayTrace::CLIENT), 0, "Wrong requests");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNReceiveCounts (1, TraceReplayTrace::CLIENT), 0, "Wrong replies");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNPackets (1, TraceReplayTrace::SERVER), 0, "Wrong server packets");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNSendCounts (1, TraceReplayTrace::SERVER), 0, "Wrong replies");
+  NS_TEST_ASSERT_MSG_EQ (trace.GetNReceiveCounts (1, TraceReplayTrace::SERVER), 0, "Wrong requests");
+}
+
+void
+TraceReplayBinaryTraceTestCase::DoRun (void)
+{
+  // A connection with parallel connections and a connection without packets
+  std::vector<TraceReplayPacket> clientPackets (2);
+  clientPackets[0].SetSize (300);
+  clientPackets[0].SetDelay (MilliSeconds (20));
+  clientPackets[0].AddParallelConnection (40001, 80, 1000);
+  clientPackets[0].AddParallelConnection (40002, 80, 2000);
+  clientPackets[1].SetSize (1460);
+  clientPackets[1].SetDelay (Seconds (0));
+  std::vector<TraceReplayPacket> serverPackets (1);
+  serverPackets[0].SetSize (500);
+  serverPackets[0].SetDelay (MilliSeconds (5));
+  std::vector<TraceReplayPacket> noPackets;
+  std::vector<uint32_t> numReq (1, 2);
+  std::vector<uint32_t> expByteServer (1, 500);
+  std::vector<uint32_t> numRep (1, 1);
+  std::vector<uint32_t> expByteClient (1, 1760);
+  std::vector<uint32_t> noCounts;
+
+  uint8_t ipClient[16] = { 0 };
+  uint8_t ipServer[16] = { 0 };
+  std::string image;
+  TraceReplayTrace::WriteHeader (image, 2, 3);
+  Ipv4Address ("10.0.0.5").Serialize (ipClient);
+  Ipv4Address ("8.8.8.8").Serialize (ipServer);
+  TraceReplayTrace::WriteConnection (image, ipClient, 40000, ipServer, 80, false, MicroSeconds (1500),
+                                     clientPackets, numReq, expByteServer, serverPackets, numRep, expByteClient);
+  uint64_t secondRecord = image.size ();
+  Ipv6Address ("2001:db8::5").Serialize (ipClient);
+  Ipv6Address ("2001:db8::1").Serialize (ipServer);
+  TraceReplayTrace::WriteConnection (image, ipClient, 50000, ipServer, 443, true, Seconds (2),
+                                     noPackets, noCounts, noCounts, noPackets, noCounts, noCounts);
+
+  std::string traceFile = CreateTempDirFilename ("trace-replay-binary.bin");
+  NS_TEST_ASSERT_MSG_EQ (WriteFile (traceFile, image), true, "Error writing " << traceFile);
+  NS_TEST_ASSERT_MSG_EQ (TraceReplayTrace::IsBinaryTrace (traceFile), true, "Binary trace file is not recognized");
+  CheckTrace (TraceReplayTrace (traceFile));
+  CheckTrace (TraceReplayTrace ("trace-replay-binary", image));
+  NS_TEST_ASSERT_MSG_EQ (LoadInChild (traceFile), 0, "Valid trace file is rejected");
+
+  // Header: magic, version, header size, number of connections at offsets 0, 4, 8 and 12.
+  // Record: offset table of its sections at 48, the end of the record after the 8 sections.
+  std::string corruptFile = CreateTempDirFilename ("trace-replay-corrupt.bin");
+  std::vector<std::string> corrupted;
+  corrupted.push_back (image.substr (0, 16));
+  corrupted.push_back (image);
+  Patch (corrupted.back (), 0, 0x12345678, 4);
+  corrupted.push_back (image);
+  Patch (corrupted.back (), 4, 99, 4);
+  corrupted.push_back (image);
+  Patch (corrupted.back (), 8, image.size () + 1, 4);
+  corrupted.push_back (image);
+  Patch (corrupted.back (), 12, 0xffffffff, 4);
+  corrupted.push_back (image);
+  Patch (corrupted.back (), 24 + 48 + 8 * 2, 121, 8);
+  corrupted.push_back (image);
+  Patch (corrupted.back (), 24 + 48 + 8 * 8, 1 << 30, 8);
+  corrupted.push_back (image);
+  Patch (corrupted.back (), secondRecord + 48, 0, 8);
+  corrupted.push_back (image.substr (0, image.size () - 1));
+  for (uint32_t i = 0; i < corrupted.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (WriteFile (corruptFile, corrupted[i]), true, "Error writing " << corruptFile);
+      NS_TEST_ASSERT_MSG_EQ (LoadInChild (corruptFile), 1, "Corrupted trace file " << i << " is not rejected");
+    }
+}
+
+/**
+ * \ingroup applications
+ * \brief Test suite of the trace replay conversion and trace files
+ */
+class TraceReplayTestSuite : public TestSuite
+{
+public:
+  TraceReplayTestSuite ();
+};
+
+TraceReplayTestSuite::TraceReplayTestSuite ()
+  : TestSuite ("trace-replay", UNIT)
+{
+  AddTestCase (new TraceReplaySubnetTestCase (false), TestCase::QUICK);
+  AddTestCase (new TraceReplaySubnetTestCase (true), TestCase::QUICK);
+  AddTestCase (new TraceReplayBinaryTraceTestCase, TestCase::QUICK);
+}
+
+static TraceReplayTestSuite traceReplayTestSuite; //!< Static variable for test initialization